@@ -4,14 +4,21 @@ uniform sampler2D sampler;
 uniform float timer;
 
 varying vec2 fragment_uv;
+varying vec2 fragment_tile;
 varying float camera_distance;
 varying float fog_factor;
 varying float diffuse;
 
 const vec3 fog_color = vec3(0.53, 0.81, 0.92);
 
+// faces merged across several blocks repeat their atlas tile once per
+// block, as fragment_uv holds the tile's corner and fragment_tile the
+// fragment's position along the face in blocks
+const float tile_size = 0.0625;
+
 void main() {
-    vec3 color = vec3(texture2D(sampler, fragment_uv));
+    vec2 uv = fragment_uv + fract(fragment_tile) * tile_size;
+    vec3 color = vec3(texture2D(sampler, uv));
     if (color == vec3(1, 0, 1)) {
         discard;
     }
@@ -2,23 +2,65 @@
 
 uniform mat4 matrix;
 uniform vec3 camera;
+uniform vec3 origin;
 
+// x, y, z in 1/256 blocks from origin, then block type + 256 * face,
+// see Vertex in util.h
 attribute vec4 position;
-attribute vec3 normal;
-attribute vec2 uv;
 
 varying vec2 fragment_uv;
+varying vec2 fragment_tile;
 varying float camera_distance;
 varying float fog_factor;
 varying float diffuse;
 
 const vec3 light_direction = normalize(vec3(-1.0, 1.0, -1.0));
+const float tile_size = 0.0625;
+const float plant_faces = 64.0;
+const float plant_angles = 48.0;
+
+// per cube face: the normal, the atlas row within the block's three and
+// the block axes the texture runs along, negated where it runs backwards
+const vec3 normals[6] = vec3[6](
+    vec3(-1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0),
+    vec3(0.0, -1.0, 0.0), vec3(0.0, 0.0, -1.0), vec3(0.0, 0.0, 1.0));
+const float rows[6] = float[6](1.0, 1.0, 2.0, 0.0, 1.0, 1.0);
+const vec3 u_axes[6] = vec3[6](
+    vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, -1.0), vec3(1.0, 0.0, 0.0),
+    vec3(1.0, 0.0, 0.0), vec3(-1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0));
+const vec3 v_axes[6] = vec3[6](
+    vec3(0.0, 1.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 0.0, -1.0),
+    vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 1.0, 0.0));
 
 void main() {
-    gl_Position = matrix * position;
-    fragment_uv = uv;
+    vec3 local = position.xyz / 256.0;
+    vec4 world = vec4(origin + local, 1.0);
+    gl_Position = matrix * world;
+
+    float w = mod(position.w, 256.0) - 1.0;
+    float face = floor(position.w / 256.0);
+    vec2 tile = vec2(mod(w, 16.0), floor(w / 16.0) * 3.0);
+    vec3 normal;
+    if (face < plant_faces) {
+        // whole blocks: the texture repeats once per block, so where a
+        // fragment falls within its block gives its place in the tile
+        int i = int(face);
+        vec3 block = local + 0.5;
+        normal = normals[i];
+        fragment_uv = (tile + vec2(0.0, rows[i])) * tile_size;
+        fragment_tile = vec2(dot(block, u_axes[i]), dot(block, v_axes[i]));
+    }
+    else {
+        float corner = mod(face, 4.0);
+        float angle = floor((face - plant_faces) / 4.0) *
+            6.28318530718 / plant_angles;
+        normal = vec3(cos(angle), 0.0, sin(angle));
+        fragment_uv = (tile + vec2(mod(corner, 2.0), floor(corner / 2.0))) *
+            tile_size;
+        fragment_tile = vec2(0.0);
+    }
 
-    camera_distance = distance(camera, vec3(position));
+    camera_distance = distance(camera, vec3(world));
     fog_factor = pow(clamp(camera_distance / 192.0, 0.0, 1.0), 4.0);
     diffuse = max(0.0, dot(normal, light_direction));
 }
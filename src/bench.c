@@ -0,0 +1,150 @@
+#define _POSIX_C_SOURCE 199309L // clock_gettime under -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "map.h"
+#include "pool.h"
+#include "world.h"
+
+// Headless microbenchmarks for chunk storage. Every result is printed as
+// one CSV line: backend,op,ops,ns_per_op. Pool counters go to stderr.
+
+#define BENCH_CHUNKS 4 // chunks per side, taken from make_world
+#define BENCH_ROUNDS 5
+
+typedef struct {
+    int x;
+    int y;
+    int z;
+    int w;
+} Block;
+
+static volatile long sink;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void alloc_map(Map *map, int dense, int p, int q) {
+    if (dense) {
+        map_alloc_chunk(map, p, q);
+    }
+    else {
+        map_alloc(map, p, q);
+    }
+}
+
+static void shuffle(Block *blocks, int count) {
+    for (int i = count - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        Block block = blocks[i];
+        blocks[i] = blocks[j];
+        blocks[j] = block;
+    }
+}
+
+static void report(const char *backend, const char *op, long ops, double ns) {
+    printf("%s,%s,%ld,%.2f\n", backend, op, ops, ops ? ns / ops : 0);
+}
+
+static void bench_backend(const char *backend, int dense) {
+    double set_ns = 0, hit_ns = 0, miss_ns = 0, grow_ns = 0, each_ns = 0;
+    long sets = 0, hits = 0, misses = 0, grows = 0, eaches = 0;
+    for (int p = 0; p < BENCH_CHUNKS; p++) {
+        for (int q = 0; q < BENCH_CHUNKS; q++) {
+            Map world;
+            alloc_map(&world, dense, p, q);
+            make_world(&world, p, q);
+            Block *blocks = (Block *)malloc(
+                MAP_LAYER * CHUNK_HEIGHT * sizeof(Block));
+            int count = 0;
+            MAP_FOR_EACH(&world, ex, ey, ez, ew) {
+                Block *block = blocks + count++;
+                block->x = ex; block->y = ey; block->z = ez; block->w = ew;
+            } END_MAP_FOR_EACH;
+            Block *empty = (Block *)malloc(count * sizeof(Block));
+            int empties = 0;
+            while (empties < count) {
+                int x = world.dx + rand() % MAP_SPAN;
+                int y = rand() % CHUNK_HEIGHT;
+                int z = world.dz + rand() % MAP_SPAN;
+                if (!map_get(&world, x, y, z)) {
+                    Block *block = empty + empties++;
+                    block->x = x; block->y = y; block->z = z; block->w = 0;
+                }
+            }
+            shuffle(blocks, count);
+            for (int round = 0; round < BENCH_ROUNDS; round++) {
+                Map map;
+                alloc_map(&map, dense, p, q);
+                double start = now();
+                for (int i = 0; i < count; i++) {
+                    Block *b = blocks + i;
+                    map_set(&map, b->x, b->y, b->z, b->w);
+                }
+                set_ns += now() - start;
+                sets += count;
+
+                long sum = 0;
+                start = now();
+                for (int i = 0; i < count; i++) {
+                    Block *b = blocks + i;
+                    sum += map_get(&map, b->x, b->y, b->z);
+                }
+                hit_ns += now() - start;
+                hits += count;
+
+                start = now();
+                for (int i = 0; i < count; i++) {
+                    Block *b = empty + i;
+                    sum += map_get(&map, b->x, b->y, b->z);
+                }
+                miss_ns += now() - start;
+                misses += count;
+
+                start = now();
+                MAP_FOR_EACH(&map, ex, ey, ez, ew) {
+                    sum += ex + ey + ez + ew;
+                } END_MAP_FOR_EACH;
+                each_ns += now() - start;
+                eaches += count;
+
+                // each call also finishes the migration the last one began
+                if (!dense) {
+                    start = now();
+                    for (int i = 0; i < 4; i++) {
+                        map_grow(&map);
+                    }
+                    grow_ns += now() - start;
+                    grows += 4;
+                }
+                sink += sum;
+                map_free(&map);
+            }
+            free(blocks);
+            free(empty);
+            map_free(&world);
+        }
+    }
+    report(backend, "map_set", sets, set_ns);
+    report(backend, "map_get_hit", hits, hit_ns);
+    report(backend, "map_get_miss", misses, miss_ns);
+    if (!dense) {
+        report(backend, "map_grow", grows, grow_ns);
+    }
+    report(backend, "map_for_each_block", eaches, each_ns);
+}
+
+int main() {
+    srand(1);
+    printf("backend,op,ops,ns_per_op\n");
+    bench_backend("dense", 1);
+    bench_backend(MAP_GROUPS ? "hash_groups" : "hash", 0);
+    PoolStats pool;
+    pool_stats(&pool);
+    fprintf(stderr, "pool: %lu hits, %lu misses, %lu slabs, %lu KB\n",
+        pool.hits, pool.misses, pool.slabs, pool.slab_bytes / 1024);
+    return 0;
+}
@@ -0,0 +1,325 @@
+#define _POSIX_C_SOURCE 200112L // dirent, stat and mkdir under -std=c99
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <utime.h>
+#include "cache.h"
+#include "world.h"
+
+#define CACHE_MAGIC 0x32484343
+#define CACHE_NAME 64
+#define CACHE_BUFFER (sizeof(CacheHeader) + CLOUD_LAYER + MAP_ENCODED_SIZE)
+
+typedef struct {
+    unsigned int magic;
+    unsigned int seed;
+    unsigned int version;
+    int p;
+    int q;
+} CacheHeader;
+
+typedef struct {
+    unsigned int seed;
+    unsigned int version;
+    int p;
+    int q;
+    long size;
+    long used;
+} CacheEntry;
+
+static int cache_enabled = 0;
+static char cache_path[256];
+static long cache_limit;
+static long cache_bytes;
+static CacheEntry *entries;
+static int entry_count;
+static int entry_capacity;
+// Open addressing over entries, each slot an entry index + 1 or 0 for
+// empty. Entries only leave in cache_evict, which rebuilds it.
+static int *entry_slots;
+static unsigned int slot_mask;
+static volatile int cache_lock = 0;
+
+// Encoding buffer, kept per thread
+static __thread unsigned char *cache_buffer;
+
+static void cache_acquire() {
+    while (__sync_lock_test_and_set(&cache_lock, 1)) {
+        while (cache_lock);
+    }
+}
+
+static void cache_release() {
+    __sync_lock_release(&cache_lock);
+}
+
+static void cache_file(
+    char *result, unsigned int seed, unsigned int version, int p, int q)
+{
+    snprintf(result, sizeof(cache_path) + CACHE_NAME,
+        "%s/%08x.%x.%d.%d.chunk", cache_path, seed, version, p, q);
+}
+
+static unsigned int cache_hash(
+    unsigned int seed, unsigned int version, int p, int q)
+{
+    unsigned int hash = seed;
+    hash = (hash ^ version) * 0x9e3779b1;
+    hash = (hash ^ (unsigned int)p) * 0x9e3779b1;
+    hash = (hash ^ (unsigned int)q) * 0x9e3779b1;
+    return hash ^ hash >> 16;
+}
+
+static int *cache_slot(
+    unsigned int seed, unsigned int version, int p, int q)
+{
+    unsigned int index = cache_hash(seed, version, p, q) & slot_mask;
+    for (;;) {
+        int *slot = entry_slots + index;
+        if (!*slot) {
+            return slot;
+        }
+        CacheEntry *entry = entries + *slot - 1;
+        if (entry->p == p && entry->q == q &&
+            entry->seed == seed && entry->version == version)
+        {
+            return slot;
+        }
+        index = (index + 1) & slot_mask;
+    }
+}
+
+// Sizes the slots to at least twice the entries and fills them again
+static void cache_index() {
+    unsigned int size = 1024;
+    while (size < (unsigned int)entry_count * 2 + 2) {
+        size *= 2;
+    }
+    if (size != slot_mask + 1) {
+        free(entry_slots);
+        entry_slots = (int *)malloc(size * sizeof(int));
+        slot_mask = size - 1;
+    }
+    memset(entry_slots, 0, size * sizeof(int));
+    for (int i = 0; i < entry_count; i++) {
+        CacheEntry *entry = entries + i;
+        *cache_slot(entry->seed, entry->version, entry->p, entry->q) = i + 1;
+    }
+}
+
+static CacheEntry *cache_find(
+    unsigned int seed, unsigned int version, int p, int q)
+{
+    int index = *cache_slot(seed, version, p, q);
+    return index ? entries + index - 1 : 0;
+}
+
+static CacheEntry *cache_add(
+    unsigned int seed, unsigned int version, int p, int q)
+{
+    if (entry_count == entry_capacity) {
+        entry_capacity = entry_capacity ? entry_capacity * 2 : 1024;
+        entries = (CacheEntry *)realloc(
+            entries, entry_capacity * sizeof(CacheEntry));
+    }
+    CacheEntry *entry = entries + entry_count++;
+    entry->seed = seed;
+    entry->version = version;
+    entry->p = p;
+    entry->q = q;
+    entry->size = 0;
+    entry->used = 0;
+    if ((unsigned int)entry_count * 2 > slot_mask + 1) {
+        cache_index();
+    }
+    else {
+        *cache_slot(seed, version, p, q) = entry_count;
+    }
+    return entry;
+}
+
+static int cache_compare(const void *a, const void *b) {
+    long x = ((const CacheEntry *)a)->used;
+    long y = ((const CacheEntry *)b)->used;
+    return x < y ? -1 : x > y;
+}
+
+// Drops the least recently used files until the cache is a quarter below
+// its limit, so eviction doesn't run again on the very next store
+static void cache_evict() {
+    char path[sizeof(cache_path) + CACHE_NAME];
+    qsort(entries, entry_count, sizeof(CacheEntry), cache_compare);
+    int removed = 0;
+    while (removed < entry_count && cache_bytes > cache_limit / 4 * 3) {
+        CacheEntry *entry = entries + removed++;
+        cache_file(path, entry->seed, entry->version, entry->p, entry->q);
+        remove(path);
+        cache_bytes -= entry->size;
+    }
+    entry_count -= removed;
+    memmove(entries, entries + removed, entry_count * sizeof(CacheEntry));
+    cache_index();
+}
+
+// Indexes the files already in path, oldest first by modification time.
+// Returns 0 if the directory can't be used, leaving the cache disabled.
+int cache_init(const char *path, long limit) {
+    snprintf(cache_path, sizeof(cache_path), "%s", path);
+    cache_limit = limit;
+    cache_bytes = 0;
+    entry_count = 0;
+    cache_index();
+    mkdir(cache_path, 0755);
+    DIR *dir = opendir(cache_path);
+    if (!dir) {
+        return 0;
+    }
+    struct dirent *item;
+    while ((item = readdir(dir))) {
+        unsigned int seed, version;
+        int p, q;
+        int length = 0;
+        if (sscanf(item->d_name, "%8x.%x.%d.%d.chunk%n",
+            &seed, &version, &p, &q, &length) != 4 ||
+            item->d_name[length])
+        {
+            continue;
+        }
+        char file[sizeof(cache_path) + CACHE_NAME];
+        struct stat info;
+        cache_file(file, seed, version, p, q);
+        if (stat(file, &info)) {
+            continue;
+        }
+        CacheEntry *entry = cache_add(seed, version, p, q);
+        entry->size = info.st_size;
+        entry->used = info.st_mtime;
+        cache_bytes += info.st_size;
+    }
+    closedir(dir);
+    cache_enabled = 1;
+    if (cache_bytes > cache_limit) {
+        cache_evict();
+    }
+    return 1;
+}
+
+void cache_close() {
+    cache_enabled = 0;
+    free(entries);
+    free(entry_slots);
+    entries = 0;
+    entry_slots = 0;
+    slot_mask = 0;
+    entry_count = 0;
+    entry_capacity = 0;
+}
+
+static unsigned char *cache_get_buffer() {
+    if (!cache_buffer) {
+        cache_buffer = (unsigned char *)malloc(CACHE_BUFFER);
+    }
+    return cache_buffer;
+}
+
+// Fills a freshly allocated dense map and clouds with the cached chunk
+// (p, q) using one sequential read, so nothing of it is generated again.
+// Returns 0 on a miss, with the map still empty.
+int cache_load(Map *map, unsigned char *clouds, int p, int q) {
+    if (!cache_enabled || !map->dense) {
+        return 0;
+    }
+    unsigned int seed = get_world_seed();
+    unsigned int version = get_world_version();
+    char path[sizeof(cache_path) + CACHE_NAME];
+    cache_file(path, seed, version, p, q);
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    unsigned char *buffer = cache_get_buffer();
+    int size = fread(buffer, 1, CACHE_BUFFER, file);
+    fclose(file);
+
+    CacheHeader header;
+    int offset = sizeof(header) + CLOUD_LAYER;
+    int valid = size >= offset;
+    if (valid) {
+        memcpy(&header, buffer, sizeof(header));
+        valid = header.magic == CACHE_MAGIC && header.seed == seed &&
+            header.version == version && header.p == p && header.q == q;
+    }
+    if (valid) {
+        valid = map_decode(map, buffer + offset, size - offset);
+    }
+    if (!valid) {
+        // a damaged file is regenerated and stored again by the caller
+        map_free(map);
+        map_alloc_chunk(map, p, q);
+        return 0;
+    }
+    cache_acquire();
+    CacheEntry *entry = cache_find(seed, version, p, q);
+    if (entry) {
+        entry->used = time(0);
+    }
+    cache_release();
+    // cache_init orders by modification time, so a hit is recorded on
+    // disk too and chunks read often survive a restart
+    utime(path, 0);
+    memcpy(clouds, buffer + sizeof(header), CLOUD_LAYER);
+    return 1;
+}
+
+// Written to a temporary file and renamed into place, so readers on other
+// threads never see half a chunk
+void cache_store(Map *map, const unsigned char *clouds, int p, int q) {
+    if (!cache_enabled) {
+        return;
+    }
+    unsigned char *buffer = cache_get_buffer();
+    CacheHeader header;
+    header.magic = CACHE_MAGIC;
+    header.seed = get_world_seed();
+    header.version = get_world_version();
+    header.p = p;
+    header.q = q;
+    int offset = sizeof(header) + CLOUD_LAYER;
+    int length = map_encode(map, buffer + offset);
+    if (!length) {
+        return;
+    }
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), clouds, CLOUD_LAYER);
+    length += offset;
+
+    char path[sizeof(cache_path) + CACHE_NAME];
+    char temp[sizeof(path) + 32];
+    cache_file(path, header.seed, header.version, p, q);
+    snprintf(temp, sizeof(temp), "%s.%p.tmp", path, (void *)buffer);
+    FILE *file = fopen(temp, "wb");
+    if (!file) {
+        return;
+    }
+    int written = fwrite(buffer, 1, length, file);
+    if (fclose(file) || written != length || rename(temp, path)) {
+        remove(temp);
+        return;
+    }
+
+    cache_acquire();
+    CacheEntry *entry = cache_find(header.seed, header.version, p, q);
+    if (!entry) {
+        entry = cache_add(header.seed, header.version, p, q);
+    }
+    cache_bytes += length - entry->size;
+    entry->size = length;
+    entry->used = time(0);
+    if (cache_bytes > cache_limit) {
+        cache_evict();
+    }
+    cache_release();
+}
@@ -0,0 +1,19 @@
+#ifndef _cache_h_
+#define _cache_h_
+
+#include "map.h"
+
+#define CACHE_PATH "cache"
+#define CACHE_LIMIT (256L * 1024 * 1024)
+
+// Generated chunk terrain and cloud cover on disk, one file per chunk keyed
+// by the world seed, the generator version and (p, q). Clouds are the
+// CLOUD_LAYER bytes make_clouds fills. Once the files pass the size limit
+// the least recently used ones are removed. Safe to call from any thread
+// between cache_init and cache_close.
+int cache_init(const char *path, long limit);
+void cache_close();
+int cache_load(Map *map, unsigned char *clouds, int p, int q);
+void cache_store(Map *map, const unsigned char *clouds, int p, int q);
+
+#endif
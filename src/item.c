@@ -0,0 +1,13 @@
+#include "item.h"
+
+int is_plant(int w) {
+	return w > 16 && w != 32;
+}
+
+int is_obstacle(int w) {
+	return w != 0 && w <= 8;
+}
+
+int is_transparent(int w) {
+	return w == 0 || w == 4 || w == 7 || is_plant(w);
+}
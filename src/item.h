@@ -0,0 +1,8 @@
+#ifndef _item_h_
+#define _item_h_
+
+int is_plant(int w);
+int is_obstacle(int w);
+int is_transparent(int w);
+
+#endif
@@ -5,16 +5,21 @@
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include "cache.h"
 #include "db.h"
+#include "item.h"
 #include "map.h"
 #include "noise.h"
 #include "util.h"
+#include "world.h"
 #include "client.h"
 
 #define VSYNC 1
 #define FULLSCREEN 0
 #define SHOW_FPS 1
-#define CHUNK_SIZE 32
+#define DENSE_CHUNKS 1
+#define CHUNK_CACHE 1
+#define GREEDY_MESH 1
 #define MAX_CHUNKS 1024
 #define CREATE_CHUNK_RADIUS 6
 #define RENDER_CHUNK_RADIUS 6
@@ -37,23 +42,12 @@ typedef struct {
     int p;
     int q;
     int faces;
-    GLuint position_buffer;
-    GLuint normal_buffer;
-    GLuint uv_buffer;
+    int dirty;
+    GLuint buffer;
+    int cloud_faces;
+    GLuint cloud_buffer;
 } Chunk;
 
-int is_plant(int w) {
-	return w > 16 && w != 32;
-}
-
-int is_obstacle(int w) {
-	return w != 0 && w <= 8;
-}
-
-int is_transparent(int w) {
-	return w == 0 || w == 4 || w == 7 || is_plant(w);;
-}
-
 void update_matrix_2d(float *matrix) {
     int width, height;
     glfwGetWindowSize(window, &width, &height);
@@ -150,16 +144,107 @@ void get_motion_vector(int flying, int sz, int sx, float rx, float ry,
     }
 }
 
-Chunk *find_chunk(Chunk *chunks, int chunk_count, int p, int q) {
+// Open addressing table of chunk index + 1 keyed by (p, q), 0 is empty
+#define CHUNK_SLOTS (MAX_CHUNKS * 2)
+static int chunk_slots[CHUNK_SLOTS];
+static Chunk *last_chunk = 0;
+
+unsigned int chunk_hash(int p, int q) {
+    return ((unsigned int)p * 73856093u ^ (unsigned int)q * 19349663u) &
+        (CHUNK_SLOTS - 1);
+}
+
+void register_chunk(Chunk *chunks, int index) {
+    Chunk *chunk = chunks + index;
+    unsigned int i = chunk_hash(chunk->p, chunk->q);
+    while (chunk_slots[i]) {
+        i = (i + 1) & (CHUNK_SLOTS - 1);
+    }
+    chunk_slots[i] = index + 1;
+}
+
+// Chunks move around the array when others are evicted, so the table is
+// rebuilt from scratch afterwards
+void rebuild_chunk_registry(Chunk *chunks, int chunk_count) {
+    memset(chunk_slots, 0, sizeof(chunk_slots));
+    last_chunk = 0;
     for (int i = 0; i < chunk_count; i++) {
-        Chunk *chunk = chunks + i;
-        if (chunk->p == p && chunk->q == q) {
+        register_chunk(chunks, i);
+    }
+}
+
+Chunk *find_chunk(Chunk *chunks, int chunk_count, int p, int q) {
+    unsigned int i = chunk_hash(p, q);
+    while (chunk_slots[i]) {
+        int index = chunk_slots[i] - 1;
+        Chunk *chunk = chunks + index;
+        if (index < chunk_count && chunk->p == p && chunk->q == q) {
             return chunk;
         }
+        i = (i + 1) & (CHUNK_SLOTS - 1);
     }
     return 0;
 }
 
+// Map of whichever chunk owns world column (x, z), 0 if that chunk is not
+// loaded. Consecutive lookups mostly hit the same chunk.
+Map *world_map(Chunk *chunks, int chunk_count, int x, int z) {
+    int p = floorf((float)x / CHUNK_SIZE);
+    int q = floorf((float)z / CHUNK_SIZE);
+    Chunk *chunk = last_chunk;
+    if (!chunk || chunk >= chunks + chunk_count ||
+        chunk->p != p || chunk->q != q)
+    {
+        chunk = find_chunk(chunks, chunk_count, p, q);
+        if (!chunk) {
+            return 0;
+        }
+        last_chunk = chunk;
+    }
+    return &chunk->map;
+}
+
+int world_get_block(Chunk *chunks, int chunk_count, int x, int y, int z) {
+    Map *map = world_map(chunks, chunk_count, x, z);
+    return map ? map_get(map, x, y, z) : 0;
+}
+
+int world_obstacle(Chunk *chunks, int chunk_count, int x, int y, int z) {
+    Map *map = world_map(chunks, chunk_count, x, z);
+    return map ? map_obstacle(map, x, y, z) : 0;
+}
+
+int world_highest_obstacle(Chunk *chunks, int chunk_count, int x, int z) {
+    Map *map = world_map(chunks, chunk_count, x, z);
+    return map ? map_highest_obstacle(map, x, z) : -1;
+}
+
+// Maps of the chunks bordering chunk, indexed by MAP_LEFT etc
+void chunk_neighbours(
+    Chunk *chunks, int chunk_count, Chunk *chunk, Map **neighbours)
+{
+    int dp[4] = {-1, 1, 0, 0};
+    int dq[4] = {0, 0, -1, 1};
+    for (int i = 0; i < 4; i++) {
+        Chunk *other = find_chunk(
+            chunks, chunk_count, chunk->p + dp[i], chunk->q + dq[i]);
+        neighbours[i] = other ? &other->map : 0;
+    }
+}
+
+// Flags the loaded chunks bordering (p, q) for remeshing, since their
+// border faces are culled against it
+void dirty_neighbours(Chunk *chunks, int chunk_count, int p, int q) {
+    int dp[4] = {-1, 1, 0, 0};
+    int dq[4] = {0, 0, -1, 1};
+    for (int i = 0; i < 4; i++) {
+        Chunk *other = find_chunk(chunks, chunk_count, p + dp[i], q + dq[i]);
+        if (other) {
+            other->dirty = 1;
+        }
+    }
+}
+
 int chunk_distance(Chunk *chunk, int p, int q) {
     int dp = ABS(chunk->p - p);
     int dq = ABS(chunk->q - q);
@@ -224,7 +309,7 @@ void print(
 int chunk_visible(Chunk *chunk, float *matrix) {
     for (int dp = 0; dp <= 1; dp++) {
         for (int dq = 0; dq <= 1; dq++) {
-            for (int y = 0; y < 128; y += 16) {
+            for (int y = 0; y < CHUNK_HEIGHT; y += 16) {
                 float vec[4] = {
                     (chunk->p + dp) * CHUNK_SIZE - dp,
                     y,
@@ -248,33 +333,29 @@ int highest_block(Chunk *chunks, int chunk_count, float x, float z) {
     int q = floorf(roundf(z) / CHUNK_SIZE);
     Chunk *chunk = find_chunk(chunks, chunk_count, p, q);
     if (chunk) {
-        Map *map = &chunk->map;
-        MAP_FOR_EACH(map, e) {
-            if (is_obstacle(e->w) && e->x == nx && e->z == nz) {
-                result = MAX(result, e->y);
-            }
-        } END_MAP_FOR_EACH;
+        result = map_highest_obstacle(&chunk->map, nx, nz);
     }
     return result;
 }
 
-int _hit_test(
-    Map *map, float max_distance, int previous,
-    float x, float y, float z,
-    float vx, float vy, float vz,
+int hit_test(
+    Chunk *chunks, int chunk_count, int previous,
+    float x, float y, float z, float rx, float ry,
     int *hx, int *hy, int *hz)
 {
     int m = 8;
     int px = 0;
     int py = 0;
     int pz = 0;
+    float max_distance = 8;
+    float vx, vy, vz;
+    get_sight_vector(rx, ry, &vx, &vy, &vz);
     for (int i = 0; i < max_distance * m; i++) {
         int nx = roundf(x);
         int ny = roundf(y);
         int nz = roundf(z);
         if (nx != px || ny != py || nz != pz) {
-            //if (map_get(map, nx, ny, nz)) {
-            int hw = map_get(map, nx, ny, nz);
+            int hw = world_get_block(chunks, chunk_count, nx, ny, nz);
             if (hw > 0) {
                 if (previous) {
                     *hx = px; *hy = py; *hz = pz;
@@ -282,7 +363,7 @@ int _hit_test(
                 else {
                     *hx = nx; *hy = ny; *hz = nz;
                 }
-                return hw;
+                return 1;
             }
             px = nx; py = ny; pz = nz;
         }
@@ -291,39 +372,6 @@ int _hit_test(
     return 0;
 }
 
-int hit_test(
-    Chunk *chunks, int chunk_count, int previous,
-    float x, float y, float z, float rx, float ry,
-    int *bx, int *by, int *bz)
-{
-    int result = 0;
-    float best = 0;
-    int p = floorf(roundf(x) / CHUNK_SIZE);
-    int q = floorf(roundf(z) / CHUNK_SIZE);
-    float vx, vy, vz;
-    get_sight_vector(rx, ry, &vx, &vy, &vz);
-    for (int i = 0; i < chunk_count; i++) {
-        Chunk *chunk = chunks + i;
-        if (chunk_distance(chunk, p, q) > 1) {
-            continue;
-        }
-        int hx, hy, hz;
-        int hw = _hit_test(&chunk->map, 8, previous,
-            x, y, z, vx, vy, vz, &hx, &hy, &hz);
-        if (hw > 0)
-        {
-            float d = sqrtf(
-                powf(hx - x, 2) + powf(hy - y, 2) + powf(hz - z, 2));
-            if (best == 0 || d < best) {
-                best = d;
-                *bx = hx; *by = hy; *bz = hz;
-            }
-            result = 1;
-        }
-    }
-    return result;
-}
-
 int collide(
     Chunk *chunks, int chunk_count,
     int height, float *x, float *y, float *z)
@@ -331,11 +379,9 @@ int collide(
     int result = 0;
     int p = floorf(roundf(*x) / CHUNK_SIZE);
     int q = floorf(roundf(*z) / CHUNK_SIZE);
-    Chunk *chunk = find_chunk(chunks, chunk_count, p, q);
-    if (!chunk) {
+    if (!find_chunk(chunks, chunk_count, p, q)) {
         return result;
     }
-    Map *map = &chunk->map;
     int nx = roundf(*x);
     int ny = roundf(*y);
     int nz = roundf(*z);
@@ -343,25 +389,36 @@ int collide(
     float py = *y - ny;
     float pz = *z - nz;
     float pad = 0.25;
+    // neighbouring columns may belong to the next chunk over
+    Chunk *c = chunks;
+    int n = chunk_count;
+    int top = world_highest_obstacle(c, n, nx, nz);
+    top = MAX(top, world_highest_obstacle(c, n, nx - 1, nz));
+    top = MAX(top, world_highest_obstacle(c, n, nx + 1, nz));
+    top = MAX(top, world_highest_obstacle(c, n, nx, nz - 1));
+    top = MAX(top, world_highest_obstacle(c, n, nx, nz + 1));
+    if (top < ny - height) {
+        return result;
+    }
     for (int dy = 0; dy < height; dy++) {
-        if (px < -pad && is_obstacle(map_get(map, nx - 1, ny - dy, nz))) {
+        if (px < -pad && world_obstacle(c, n, nx - 1, ny - dy, nz)) {
             *x = nx - pad;
         }
-        if (px > pad && is_obstacle(map_get(map, nx + 1, ny - dy, nz))) {
+        if (px > pad && world_obstacle(c, n, nx + 1, ny - dy, nz)) {
             *x = nx + pad;
         }
-        if (py < -pad && is_obstacle(map_get(map, nx, ny - dy - 1, nz))) {
+        if (py < -pad && world_obstacle(c, n, nx, ny - dy - 1, nz)) {
             *y = ny - pad;
             result = 1;
         }
-        if (py > pad && is_obstacle(map_get(map, nx, ny - dy + 1, nz))) {
+        if (py > pad && world_obstacle(c, n, nx, ny - dy + 1, nz)) {
             *y = ny + pad;
             result = 1;
         }
-        if (pz < -pad && is_obstacle(map_get(map, nx, ny - dy, nz - 1))) {
+        if (pz < -pad && world_obstacle(c, n, nx, ny - dy, nz - 1)) {
             *z = nz - pad;
         }
-        if (pz > pad && is_obstacle(map_get(map, nx, ny - dy, nz + 1))) {
+        if (pz > pad && world_obstacle(c, n, nx, ny - dy, nz + 1)) {
             *z = nz + pad;
         }
     }
@@ -384,115 +441,235 @@ int player_intersects_block(
     return 0;
 }
 
-void exposed_faces(
-    Map *map, int x, int y, int z,
-    int *f1, int *f2, int *f3, int *f4, int *f5, int *f6)
+typedef struct {
+    int face;
+    int x;
+    int y;
+    int z;
+    int width;
+    int height;
+    int w;
+} Quad;
+
+// Chunk-local block behind the (u, v) cell of a slice of faces pointing
+// along face, with u and v laid out as make_quad expects
+void quad_block(int face, int slice, int u, int v, int *x, int *y, int *z) {
+    if (face < 2) {
+        *x = slice; *y = v; *z = u;
+    }
+    else if (face < 4) {
+        *x = u; *y = slice; *z = v;
+    }
+    else {
+        *x = u; *y = v; *z = slice;
+    }
+}
+
+// Merges the faces of one slice into rectangles of a single block type:
+// each starts at the first face left, grows along u while the block
+// matches, then along v while the whole next row does
+void merge_quads(
+    int *mask, int face, int slice, int width, int height,
+    Quad **quads, int *count, int *capacity)
 {
-	
-	 
-    *f1 = is_transparent(map_get(map, x - 1, y, z));
-    *f2 = is_transparent(map_get(map, x + 1, y, z));
-    *f3 = is_transparent(map_get(map, x, y + 1, z));
-    *f4 = is_transparent(map_get(map, x, y - 1, z)) && (y > 0);
-    *f5 = is_transparent(map_get(map, x, y, z + 1));
-    *f6 = is_transparent(map_get(map, x, y, z - 1));
-    
-    /*
-    *f1 = map_get(map, x - 1, y, z) == 0;
-    *f2 = map_get(map, x + 1, y, z) == 0;
-    *f3 = map_get(map, x, y + 1, z) == 0;
-    *f4 = map_get(map, x, y - 1, z) == 0 && y > 0;
-    *f5 = map_get(map, x, y, z + 1) == 0;
-    *f6 = map_get(map, x, y, z - 1) == 0;
-    */
+    for (int v = 0; v < height; v++) {
+        for (int u = 0; u < width; u++) {
+            int w = mask[v * width + u];
+            if (!w) {
+                continue;
+            }
+            int du = 1;
+            int dv = 1;
+            if (GREEDY_MESH) {
+                while (u + du < width && mask[v * width + u + du] == w) {
+                    du++;
+                }
+                for (; v + dv < height; dv++) {
+                    int *row = mask + (v + dv) * width + u;
+                    int k = 0;
+                    while (k < du && row[k] == w) {
+                        k++;
+                    }
+                    if (k < du) {
+                        break;
+                    }
+                }
+            }
+            for (int j = 0; j < dv; j++) {
+                for (int k = 0; k < du; k++) {
+                    mask[(v + j) * width + u + k] = 0;
+                }
+            }
+            if (*count == *capacity) {
+                *capacity = *capacity ? *capacity * 2 : 1024;
+                *quads = realloc(*quads, *capacity * sizeof(Quad));
+            }
+            Quad *quad = *quads + (*count)++;
+            quad->face = face;
+            quad_block(face, slice, u, v, &quad->x, &quad->y, &quad->z);
+            quad->width = du;
+            quad->height = dv;
+            quad->w = w;
+        }
+    }
 }
 
-void update_chunk(Chunk *chunk) {
+void update_chunk(Chunk *chunks, int chunk_count, Chunk *chunk) {
     Map *map = &chunk->map;
+    Map *neighbours[4];
+    chunk_neighbours(chunks, chunk_count, chunk, neighbours);
+    chunk->dirty = 0;
 
     if (chunk->faces) {
-        glDeleteBuffers(1, &chunk->position_buffer);
-        glDeleteBuffers(1, &chunk->normal_buffer);
-        glDeleteBuffers(1, &chunk->uv_buffer);
+        glDeleteBuffers(1, &chunk->buffer);
     }
 
-    int faces = 0;
-    MAP_FOR_EACH(map, e) {
-        if (e->w <= 0) {
+    // block ids by chunk-local (y, z, x), and rows of which are cubes and
+    // which are plants
+    int *blocks = calloc(MAP_LAYER * CHUNK_HEIGHT, sizeof(int));
+    MapRow *cubes = calloc(MAP_ROWS, sizeof(MapRow));
+    MapRow *plants = calloc(MAP_ROWS, sizeof(MapRow));
+    int top = 0;
+    MAP_FOR_EACH(map, ex, ey, ez, ew) {
+        if (ew <= 0) {
             continue;
         }
-        int f1, f2, f3, f4, f5, f6;
-        exposed_faces(map, e->x, e->y, e->z, &f1, &f2, &f3, &f4, &f5, &f6);
-        int total = f1 + f2 + f3 + f4 + f5 + f6;
-        if(is_plant(e->w)) {
-			total = total ? 4 : 0;
-		}
-        faces += total;
+        int i = ey * MAP_SPAN + ez - map->dz;
+        blocks[i * MAP_SPAN + ex - map->dx] = ew;
+        if (is_plant(ew)) {
+            plants[i] |= (MapRow)1 << (ex - map->dx);
+        }
+        else {
+            cubes[i] |= (MapRow)1 << (ex - map->dx);
+        }
+        top = MAX(top, ey + 1);
     } END_MAP_FOR_EACH;
 
-    GLfloat *position_data = malloc(sizeof(GLfloat) * faces * 18);
-    GLfloat *normal_data = malloc(sizeof(GLfloat) * faces * 18);
-    GLfloat *uv_data = malloc(sizeof(GLfloat) * faces * 12);
-    int position_offset = 0;
-    int uv_offset = 0;
-    MAP_FOR_EACH(map, e) {
-        if (e->w <= 0) {
-            continue;
+    // plants show whole as long as any of their faces is exposed
+    MapRow (*exposed)[6] = malloc(sizeof(MapRow) * 6 * MAP_ROWS);
+    int plant_count = 0;
+    for (int i = 0; i < top * MAP_SPAN; i++) {
+        MapRow *faces = exposed[i];
+        map_row_faces(map, neighbours, i / MAP_SPAN,
+            map->dz + i % MAP_SPAN, faces);
+        MapRow any = 0;
+        for (int f = 0; f < 6; f++) {
+            any |= faces[f];
+            faces[f] &= cubes[i];
         }
-        int f1, f2, f3, f4, f5, f6;
-        exposed_faces(map, e->x, e->y, e->z, &f1, &f2, &f3, &f4, &f5, &f6);
-        int total = f1 + f2 + f3 + f4 + f5 + f6;
-        
-        if(is_plant(e->w)) {
-			total = total ? 4 : 0;
-		}
-		
-        if(total == 0) {
-            continue;
+        plants[i] &= any;
+        plant_count += __builtin_popcountll(plants[i]);
+    }
+
+    Quad *quads = 0;
+    int quad_count = 0;
+    int quad_capacity = 0;
+    int mask[MAP_SPAN * CHUNK_HEIGHT];
+    for (int face = 0; face < 6; face++) {
+        int slices = face == 2 || face == 3 ? top : MAP_SPAN;
+        int height = face == 2 || face == 3 ? MAP_SPAN : top;
+        for (int slice = 0; slice < slices; slice++) {
+            for (int v = 0; v < height; v++) {
+                for (int u = 0; u < MAP_SPAN; u++) {
+                    int x, y, z;
+                    quad_block(face, slice, u, v, &x, &y, &z);
+                    int i = y * MAP_SPAN + z;
+                    mask[v * MAP_SPAN + u] = exposed[i][face] >> x & 1 ?
+                        blocks[i * MAP_SPAN + x] : 0;
+                }
+            }
+            merge_quads(mask, face, slice, MAP_SPAN, height,
+                &quads, &quad_count, &quad_capacity);
         }
-        
-        if(is_plant(e->w)) {
-			float rotation = simplex3(e->x, e->y, e->z, 4, 0.5, 2) * 360;
-			make_plant(
-				position_data + position_offset,
-				normal_data + position_offset,
-				uv_data + uv_offset,
-				e->x, e->y, e->z, 0.5, e->w, rotation);
-		} else {
-			make_cube(
-				position_data + position_offset,
-				normal_data + position_offset,
-				uv_data + uv_offset,
-				f1, f2, f3, f4, f5, f6,
-				e->x, e->y, e->z, 0.5, e->w);
-		}
-        position_offset += total * 18;
-        uv_offset += total * 12;
-    } END_MAP_FOR_EACH;
+    }
 
-    GLuint position_buffer = make_buffer(
-        GL_ARRAY_BUFFER,
-        sizeof(GLfloat) * faces * 18,
-        position_data
-    );
-    GLuint normal_buffer = make_buffer(
-        GL_ARRAY_BUFFER,
-        sizeof(GLfloat) * faces * 18,
-        normal_data
-    );
-    GLuint uv_buffer = make_buffer(
-        GL_ARRAY_BUFFER,
-        sizeof(GLfloat) * faces * 12,
-        uv_data
-    );
-    free(position_data);
-    free(normal_data);
-    free(uv_data);
+    // vertices are placed relative to the chunk origin, see Vertex
+    int faces = quad_count + plant_count * 4;
+    Vertex *data = malloc(sizeof(Vertex) * faces * 6);
+    int offset = 0;
+    for (int i = 0; i < quad_count; i++) {
+        Quad *quad = quads + i;
+        make_quad(data + offset, quad->face,
+            quad->x + VERTEX_ORIGIN, quad->y + VERTEX_ORIGIN,
+            quad->z + VERTEX_ORIGIN, 0.5,
+            quad->width, quad->height, quad->w);
+        offset += 6;
+    }
+    for (int i = 0; i < top * MAP_SPAN; i++) {
+        for (MapRow row = plants[i]; row; row &= row - 1) {
+            int x = __builtin_ctzll(row);
+            int y = i / MAP_SPAN;
+            int z = i % MAP_SPAN;
+            float rotation = simplex3(
+                map->dx + x, y, map->dz + z, 4, 0.5, 2) * 360;
+            make_plant(data + offset,
+                x + VERTEX_ORIGIN, y + VERTEX_ORIGIN, z + VERTEX_ORIGIN,
+                0.5, blocks[i * MAP_SPAN + x], rotation);
+            offset += 4 * 6;
+        }
+    }
+    free(blocks);
+    free(cubes);
+    free(plants);
+    free(exposed);
+    free(quads);
 
     chunk->faces = faces;
-    chunk->position_buffer = position_buffer;
-    chunk->normal_buffer = normal_buffer;
-    chunk->uv_buffer = uv_buffer;
+    chunk->buffer = make_buffer(
+        GL_ARRAY_BUFFER, sizeof(Vertex) * faces * 6, data);
+    free(data);
+}
+
+// Clouds live outside the chunk map in a mesh of their own, built once
+// when the chunk is made and drawn in a separate pass
+void update_clouds(Chunk *chunk, unsigned char *clouds) {
+    int exposed[CHUNK_SIZE * CHUNK_SIZE][6];
+    int faces = 0;
+    for (int dz = 0; dz < CHUNK_SIZE; dz++) {
+        for (int dx = 0; dx < CHUNK_SIZE; dx++) {
+            int i = (dz + CLOUD_PAD) * CLOUD_SPAN + dx + CLOUD_PAD;
+            int c = clouds[i];
+            int *e = exposed[dz * CHUNK_SIZE + dx];
+            e[0] = c & ~clouds[i - 1];
+            e[1] = c & ~clouds[i + 1];
+            e[2] = c & ~(c >> 1);
+            e[3] = c & ~(c << 1);
+            e[4] = c & ~clouds[i + CLOUD_SPAN];
+            e[5] = c & ~clouds[i - CLOUD_SPAN];
+            for (int f = 0; f < 6; f++) {
+                faces += __builtin_popcount(e[f]);
+            }
+        }
+    }
+
+    Vertex *data = malloc(sizeof(Vertex) * faces * 6);
+    int offset = 0;
+    for (int dz = 0; dz < CHUNK_SIZE; dz++) {
+        for (int dx = 0; dx < CHUNK_SIZE; dx++) {
+            int *e = exposed[dz * CHUNK_SIZE + dx];
+            for (int y = 0; y < CLOUD_LAYERS; y++) {
+                int f[6];
+                int total = 0;
+                for (int k = 0; k < 6; k++) {
+                    f[k] = (e[k] >> y) & 1;
+                    total += f[k];
+                }
+                if (total == 0) {
+                    continue;
+                }
+                make_cube(data + offset,
+                    f[0], f[1], f[2], f[3], f[4], f[5],
+                    dx + VERTEX_ORIGIN, CLOUD_BOTTOM + y + VERTEX_ORIGIN,
+                    dz + VERTEX_ORIGIN, 0.5, 32);
+                offset += total * 6;
+            }
+        }
+    }
+
+    chunk->cloud_faces = faces;
+    chunk->cloud_buffer = make_buffer(
+        GL_ARRAY_BUFFER, sizeof(Vertex) * faces * 6, data);
+    free(data);
 }
 
 void make_chunk(Chunk *chunk, int p, int q) {
@@ -504,28 +681,47 @@ void make_chunk(Chunk *chunk, int p, int q) {
     chunk->q = q;
     chunk->faces = 0;
     Map *map = &chunk->map;
-    map_alloc(map);
-    make_world(map, p, q);
-    update_chunk(chunk);
+    if (DENSE_CHUNKS) {
+        map_alloc_chunk(map, p, q);
+    }
+    else {
+        map_alloc(map, p, q);
+    }
+    unsigned char clouds[CLOUD_LAYER];
+    if (!cache_load(map, clouds, p, q)) {
+        make_world(map, p, q);
+        make_clouds(clouds, p, q);
+        cache_store(map, clouds, p, q);
+    }
+    db_update_chunk(map, p, q);
+    chunk->dirty = 1;
+    update_clouds(chunk, clouds);
 }
 
-void draw_chunk(
-    Chunk *chunk, GLuint position_loc, GLuint normal_loc, GLuint uv_loc)
+// Vertices are unpacked by the block shader, relative to origin
+void draw_faces(
+    Chunk *chunk, GLuint buffer, int faces,
+    GLuint origin_loc, GLuint position_loc)
 {
+    glUniform3f(origin_loc,
+        chunk->p * CHUNK_SIZE - VERTEX_ORIGIN, -VERTEX_ORIGIN,
+        chunk->q * CHUNK_SIZE - VERTEX_ORIGIN);
     glEnableVertexAttribArray(position_loc);
-    glEnableVertexAttribArray(normal_loc);
-    glEnableVertexAttribArray(uv_loc);
-    glBindBuffer(GL_ARRAY_BUFFER, chunk->position_buffer);
-    glVertexAttribPointer(position_loc, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, chunk->normal_buffer);
-    glVertexAttribPointer(normal_loc, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, chunk->uv_buffer);
-    glVertexAttribPointer(uv_loc, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(
+        position_loc, 4, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(Vertex), 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glDrawArrays(GL_TRIANGLES, 0, chunk->faces * 6);
+    glDrawArrays(GL_TRIANGLES, 0, faces * 6);
     glDisableVertexAttribArray(position_loc);
-    glDisableVertexAttribArray(normal_loc);
-    glDisableVertexAttribArray(uv_loc);
+}
+
+void draw_chunk(Chunk *chunk, GLuint origin_loc, GLuint position_loc) {
+    draw_faces(chunk, chunk->buffer, chunk->faces, origin_loc, position_loc);
+}
+
+void draw_clouds(Chunk *chunk, GLuint origin_loc, GLuint position_loc) {
+    draw_faces(chunk, chunk->cloud_buffer, chunk->cloud_faces,
+        origin_loc, position_loc);
 }
 
 void draw_lines(GLuint buffer, GLuint position_loc, int size, int count) {
@@ -537,26 +733,41 @@ void draw_lines(GLuint buffer, GLuint position_loc, int size, int count) {
     glDisableVertexAttribArray(position_loc);
 }
 
+// Meshes run after a whole batch of chunks is loaded, so new chunks don't
+// remesh the neighbours they share over and over
+void update_dirty_chunks(Chunk *chunks, int chunk_count) {
+    for (int i = 0; i < chunk_count; i++) {
+        if (chunks[i].dirty) {
+            update_chunk(chunks, chunk_count, chunks + i);
+        }
+    }
+}
+
 void ensure_chunks(Chunk *chunks, int *chunk_count, int p, int q, int force) {
     int count = *chunk_count;
+    int evicted = 0;
     for (int i = 0; i < count; i++) {
         Chunk *chunk = chunks + i;
         if (chunk_distance(chunk, p, q) >= DELETE_CHUNK_RADIUS) {
             map_free(&chunk->map);
-            glDeleteBuffers(1, &chunk->position_buffer);
-            glDeleteBuffers(1, &chunk->normal_buffer);
-            glDeleteBuffers(1, &chunk->uv_buffer);
+            glDeleteBuffers(1, &chunk->buffer);
+            glDeleteBuffers(1, &chunk->cloud_buffer);
             Chunk *other = chunks + (count - 1);
             chunk->map = other->map;
             chunk->p = other->p;
             chunk->q = other->q;
             chunk->faces = other->faces;
-            chunk->position_buffer = other->position_buffer;
-            chunk->normal_buffer = other->normal_buffer;
-            chunk->uv_buffer = other->uv_buffer;
+            chunk->dirty = other->dirty;
+            chunk->buffer = other->buffer;
+            chunk->cloud_faces = other->cloud_faces;
+            chunk->cloud_buffer = other->cloud_buffer;
             count--;
+            evicted = 1;
         }
     }
+    if (evicted) {
+        rebuild_chunk_registry(chunks, count);
+    }
     int n = CREATE_CHUNK_RADIUS;
     for (int i = -n; i <= n; i++) {
         for (int j = -n; j <= n; j++) {
@@ -564,14 +775,18 @@ void ensure_chunks(Chunk *chunks, int *chunk_count, int p, int q, int force) {
             int b = q + j;
             if (!find_chunk(chunks, count, a, b)) {
                 make_chunk(chunks + count, a, b);
+                register_chunk(chunks, count);
+                dirty_neighbours(chunks, count, a, b);
                 count++;
                 if (!force) {
+                    update_dirty_chunks(chunks, count);
                     *chunk_count = count;
                     return;
                 }
             }
         }
     }
+    update_dirty_chunks(chunks, count);
     *chunk_count = count;
 }
 
@@ -583,7 +798,7 @@ void _set_block(
     if (chunk) {
         Map *map = &chunk->map;
         map_set(map, x, y, z, w);
-        update_chunk(chunk);
+        update_chunk(chunks, chunk_count, chunk);
     }
     /*
 		Test server connection - OLD
@@ -596,6 +811,9 @@ void _set_block(
 }
 
 void set_block(Chunk *chunks, int chunk_count, int x, int y, int z, int w) {
+    if (y < 0 || y >= CHUNK_HEIGHT) {
+        return;
+    }
     int p = floorf((float)x / CHUNK_SIZE);
     int q = floorf((float)z / CHUNK_SIZE);
     char buffer[1024];
@@ -603,20 +821,20 @@ void set_block(Chunk *chunks, int chunk_count, int x, int y, int z, int w) {
     snprintf(buffer, 1024, "B,%d,%d,%d,%d,%d,%d\n", p, q, x, y, z, w);
     client_send(buffer);
     _set_block(chunks, chunk_count, p, q, x, y, z, w);
-    w = w ? -1 : 0;
-    int p0 = x == p * CHUNK_SIZE;
-    int q0 = z == q * CHUNK_SIZE;
-    int p1 = x == p * CHUNK_SIZE + CHUNK_SIZE - 1;
-    int q1 = z == q * CHUNK_SIZE + CHUNK_SIZE - 1;
-    for (int dp = -1; dp <= 1; dp++) {
-        for (int dq = -1; dq <= 1; dq++) {
-            if (dp == 0 && dq == 0) continue;
-            if (dp < 0 && !p0) continue;
-            if (dp > 0 && !p1) continue;
-            if (dq < 0 && !q0) continue;
-            if (dq > 0 && !q1) continue;
-            _set_block(chunks, chunk_count, p + dp, q + dq, x, y, z, w);
-        }
+    // a block on the border changes which faces the neighbour shows
+    int dp = 0;
+    int dq = 0;
+    if (x == p * CHUNK_SIZE) dp = -1;
+    if (x == p * CHUNK_SIZE + CHUNK_SIZE - 1) dp = 1;
+    if (z == q * CHUNK_SIZE) dq = -1;
+    if (z == q * CHUNK_SIZE + CHUNK_SIZE - 1) dq = 1;
+    Chunk *other = dp ? find_chunk(chunks, chunk_count, p + dp, q) : 0;
+    if (other) {
+        update_chunk(chunks, chunk_count, other);
+    }
+    other = dq ? find_chunk(chunks, chunk_count, p, q + dq) : 0;
+    if (other) {
+        update_chunk(chunks, chunk_count, other);
     }
 }
 
@@ -765,6 +983,9 @@ int main(int argc, char **argv) {
     if (db_init()) {
         return -1;
     }
+    if (CHUNK_CACHE) {
+        cache_init(CACHE_PATH, CACHE_LIMIT);
+    }
 
     glEnable(GL_CULL_FACE);
     glEnable(GL_DEPTH_TEST);
@@ -796,11 +1017,10 @@ int main(int argc, char **argv) {
     GLuint block_program = load_program("shaders/block_vertex.glsl", "shaders/block_fragment.glsl");
     GLuint matrix_loc = glGetUniformLocation(block_program, "matrix");
     GLuint camera_loc = glGetUniformLocation(block_program, "camera");
+    GLuint origin_loc = glGetUniformLocation(block_program, "origin");
     GLuint sampler_loc = glGetUniformLocation(block_program, "sampler");
     GLuint timer_loc = glGetUniformLocation(block_program, "timer");
     GLuint position_loc = glGetAttribLocation(block_program, "position");
-    GLuint normal_loc = glGetAttribLocation(block_program, "normal");
-    GLuint uv_loc = glGetAttribLocation(block_program, "uv");
 
 	//GLuint line_program;
     GLuint line_program = load_program("shaders/line_vertex.glsl", "shaders/line_fragment.glsl");
@@ -983,7 +1203,19 @@ int main(int argc, char **argv) {
             if (!chunk_visible(chunk, matrix)) {
                 continue;
             }
-            draw_chunk(chunk, position_loc, normal_loc, uv_loc);
+            draw_chunk(chunk, origin_loc, position_loc);
+        }
+
+        // render clouds
+        for (int i = 0; i < chunk_count; i++) {
+            Chunk *chunk = chunks + i;
+            if (chunk_distance(chunk, p, q) > RENDER_CHUNK_RADIUS) {
+                continue;
+            }
+            if (!chunk_visible(chunk, matrix)) {
+                continue;
+            }
+            draw_clouds(chunk, origin_loc, position_loc);
         }
 
         // render focused block wireframe
@@ -1047,6 +1279,7 @@ int main(int argc, char **argv) {
     client_stop();
     db_save_state(x, y, z, rx, ry);
     db_close();
+    cache_close();
     glfwTerminate();
     return 0;
 }
@@ -1,10 +1,11 @@
 #include <stdlib.h>
+#include <string.h>
+#if MAP_GROUPS && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "map.h"
-#include "db.h"
-#include "util.h" // random_number
-#include "noise.h"
-
-#define CHUNK_SIZE 32
+#include "item.h"
+#include "pool.h"
 
 int hash_int(int key) {
     key = ~key + (key << 15);
@@ -16,161 +17,700 @@ int hash_int(int key) {
     return key;
 }
 
-int hash(int x, int y, int z) {
-    x = hash_int(x);
-    y = hash_int(y);
-    z = hash_int(z);
-    return x ^ y ^ z;
+// Hash table slots hold an index + 1 into the dense entry list
+#define SLOT_EMPTY 0
+#define SLOT_DELETED 0xffffffffu
+#define SLOT_LIVE(slot) ((slot) != SLOT_EMPTY && (slot) != SLOT_DELETED)
+
+#if MAP_GROUPS
+
+// One byte per slot: 0 when empty, 1 when deleted, otherwise the top seven
+// hash bits with the high bit set, so a group of slots can be filtered
+// before any Entry is touched.
+#define MAP_TAG(hash) (0x80 | (unsigned int)(hash) >> 25)
+#define TAG_DELETED 1
+#define MAP_GROUP 16
+#define MAP_LIMIT(mask) (((mask) + 1) / 8 * 7)
+
+// Bit i is set when tags[i] == tag, for one group of MAP_GROUP tags
+static unsigned int map_match(const unsigned char *tags, unsigned char tag) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i *)tags);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(tag)));
+#else
+    unsigned int result = 0;
+    for (int i = 0; i < MAP_GROUP; i++) {
+        result |= (tags[i] == tag) << i;
+    }
+    return result;
+#endif
+}
+
+// Returns the slot holding key, or else the slot to insert it at: the
+// first deleted slot passed, or the empty slot that ended the probe
+static unsigned int *map_probe(
+    Map *map, unsigned int *slots, unsigned char *tags, unsigned int mask,
+    unsigned int key)
+{
+    unsigned int hash = hash_int(key);
+    unsigned int group = hash & mask & ~(MAP_GROUP - 1);
+    unsigned int *result = 0;
+    for (;;) {
+        unsigned int bits = map_match(tags + group, MAP_TAG(hash));
+        while (bits) {
+            unsigned int *slot = slots + group + __builtin_ctz(bits);
+            if (map->data[*slot - 1].key == key) {
+                return slot;
+            }
+            bits &= bits - 1;
+        }
+        if (!result) {
+            bits = map_match(tags + group, TAG_DELETED);
+            if (bits) {
+                result = slots + group + __builtin_ctz(bits);
+            }
+        }
+        bits = map_match(tags + group, 0);
+        if (bits) {
+            return result ? result : slots + group + __builtin_ctz(bits);
+        }
+        group = (group + MAP_GROUP) & mask;
+    }
+}
+
+static unsigned char *map_tags(unsigned int mask) {
+    return (unsigned char *)pool_calloc(mask + 1, sizeof(unsigned char));
 }
 
-void map_alloc(Map *map) {
+// Mirrors the state of slot into its tag byte
+static void map_tag(
+    unsigned int *slots, unsigned char *tags, unsigned int *slot,
+    unsigned int key)
+{
+    if (SLOT_LIVE(*slot)) {
+        tags[slot - slots] = MAP_TAG(hash_int(key));
+    }
+    else {
+        tags[slot - slots] = *slot == SLOT_DELETED ? TAG_DELETED : 0;
+    }
+}
+
+#else
+
+#define MAP_LIMIT(mask) (((mask) + 1) / 2)
+
+// Returns the slot holding key, or else the slot to insert it at: the
+// first deleted slot passed, or the empty slot that ended the probe
+static unsigned int *map_probe(
+    Map *map, unsigned int *slots, unsigned char *tags, unsigned int mask,
+    unsigned int key)
+{
+    (void)tags;
+    unsigned int index = hash_int(key) & mask;
+    unsigned int *result = 0;
+    for (;;) {
+        unsigned int *slot = slots + index;
+        if (*slot == SLOT_EMPTY) {
+            return result ? result : slot;
+        }
+        if (*slot == SLOT_DELETED) {
+            if (!result) {
+                result = slot;
+            }
+        }
+        else if (map->data[*slot - 1].key == key) {
+            return slot;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+// Without groups there are no tags; these keep the callers shared
+static unsigned char *map_tags(unsigned int mask) {
+    (void)mask;
+    return 0;
+}
+
+static void map_tag(
+    unsigned int *slots, unsigned char *tags, unsigned int *slot,
+    unsigned int key)
+{
+    (void)slots;
+    (void)tags;
+    (void)slot;
+    (void)key;
+}
+
+#endif
+
+// Per column heights start out as -1, meaning nothing in the column
+static void map_alloc_heights(Map *map) {
+    map->highest_obstacle = (signed char *)pool_alloc(MAP_LAYER);
+    map->highest_block = (signed char *)pool_alloc(MAP_LAYER);
+    memset(map->highest_obstacle, -1, MAP_LAYER);
+    memset(map->highest_block, -1, MAP_LAYER);
+    map->opaque = (MapRow *)pool_calloc(MAP_ROWS, sizeof(MapRow));
+    map->obstacle = (MapRow *)pool_calloc(MAP_ROWS, sizeof(MapRow));
+}
+
+void map_alloc(Map *map, int p, int q) {
     map->mask = 0xfff;
     map->size = 0;
-    map->data = (Entry *)calloc(map->mask + 1, sizeof(Entry));
+    map->deleted = 0;
+    map->data = (Entry *)pool_alloc(MAP_LIMIT(map->mask) * sizeof(Entry));
+    map->slots = (unsigned int *)pool_calloc(
+        map->mask + 1, sizeof(unsigned int));
+    map->tags = map_tags(map->mask);
+    map->old_mask = 0;
+    map->moved = 0;
+    map->old_slots = 0;
+    map->old_tags = 0;
+    map->dense = 0;
+    map->dx = p * CHUNK_SIZE;
+    map->dz = q * CHUNK_SIZE;
+    map->palette = 0;
+    map->blocks = 0;
+    map_alloc_heights(map);
+    map->version = 0;
+    map->snapshot = 0;
+}
+
+// Dense storage for one chunk: a MAP_SPAN x CHUNK_HEIGHT x MAP_SPAN array
+// of palette indices, x fastest, then z, then y. Index 0 is always air.
+void map_alloc_chunk(Map *map, int p, int q) {
+    map->mask = 0;
+    map->size = 0;
+    map->deleted = 0;
+    map->data = 0;
+    map->slots = 0;
+    map->tags = 0;
+    map->old_mask = 0;
+    map->moved = 0;
+    map->old_slots = 0;
+    map->old_tags = 0;
+    map->dense = 1;
+    map->dx = p * CHUNK_SIZE;
+    map->dz = q * CHUNK_SIZE;
+    map->top = 0;
+    map->palette_size = 1;
+    map->palette = (int *)pool_calloc(MAP_PALETTE_SIZE, sizeof(int));
+    map->blocks = (unsigned char *)pool_calloc(
+        MAP_LAYER * CHUNK_HEIGHT, sizeof(unsigned char));
+    map_alloc_heights(map);
+    map->version = 0;
+    map->snapshot = 0;
+}
+
+static void map_free_buffers(Map *map) {
+    pool_free(map->data);
+    pool_free(map->slots);
+    pool_free(map->tags);
+    pool_free(map->old_slots);
+    pool_free(map->old_tags);
+    pool_free(map->palette);
+    pool_free(map->blocks);
+    pool_free(map->highest_obstacle);
+    pool_free(map->highest_block);
+    pool_free(map->opaque);
+    pool_free(map->obstacle);
 }
 
 void map_free(Map *map) {
-    free(map->data);
+    if (map->snapshot) {
+        map_release(map->snapshot);
+        map->snapshot = 0;
+        return;
+    }
+    map_free_buffers(map);
+}
+
+static void *map_copy(const void *data, size_t size) {
+    if (!data) {
+        return 0;
+    }
+    void *result = pool_alloc(size);
+    memcpy(result, data, size);
+    return result;
 }
 
-void map_grow(Map *map);
+// Copy-on-write: a snapshot freezes the Map header and takes over its
+// buffers. The Map keeps reading them until its next map_set, which copies
+// them first, so readers holding the snapshot never see a change.
+MapSnapshot *map_snapshot(Map *map) {
+    MapSnapshot *snapshot = map->snapshot;
+    if (!snapshot) {
+        snapshot = (MapSnapshot *)pool_alloc(sizeof(MapSnapshot));
+        snapshot->map = *map;
+        snapshot->map.snapshot = snapshot;
+        snapshot->refs = 1;
+        map->snapshot = snapshot;
+    }
+    __sync_add_and_fetch(&snapshot->refs, 1);
+    return snapshot;
+}
 
-void map_set(Map *map, int x, int y, int z, int w) {
-    unsigned int index = hash(x, y, z) & map->mask;
-    Entry *entry = map->data + index;
-    int overwrite = 0;
-    while (!EMPTY_ENTRY(entry)) {
-        if (entry->x == x && entry->y == y && entry->z == z) {
-            overwrite = 1;
-            break;
+// May be called from any thread
+void map_release(MapSnapshot *snapshot) {
+    if (__sync_sub_and_fetch(&snapshot->refs, 1) == 0) {
+        map_free_buffers(&snapshot->map);
+        pool_free(snapshot);
+    }
+}
+
+static void map_unshare(Map *map) {
+    MapSnapshot *snapshot = map->snapshot;
+    map->snapshot = 0;
+    // only this thread hands out references, so when the Map holds the
+    // last one nobody else can be reading and the buffers are ours again
+    if (snapshot->refs == 1) {
+        pool_free(snapshot);
+        return;
+    }
+    map->data = (Entry *)map_copy(
+        map->data, map->data ? MAP_LIMIT(map->mask) * sizeof(Entry) : 0);
+    map->slots = (unsigned int *)map_copy(
+        map->slots, (map->mask + 1) * sizeof(unsigned int));
+    map->tags = (unsigned char *)map_copy(map->tags, map->mask + 1);
+    map->old_slots = (unsigned int *)map_copy(
+        map->old_slots, (map->old_mask + 1) * sizeof(unsigned int));
+    map->old_tags = (unsigned char *)map_copy(
+        map->old_tags, map->old_mask + 1);
+    map->palette = (int *)map_copy(
+        map->palette, MAP_PALETTE_SIZE * sizeof(int));
+    map->blocks = (unsigned char *)map_copy(
+        map->blocks, MAP_LAYER * CHUNK_HEIGHT);
+    map->highest_obstacle = (signed char *)map_copy(
+        map->highest_obstacle, MAP_LAYER);
+    map->highest_block = (signed char *)map_copy(
+        map->highest_block, MAP_LAYER);
+    map->opaque = (MapRow *)map_copy(map->opaque, MAP_ROWS * sizeof(MapRow));
+    map->obstacle = (MapRow *)map_copy(
+        map->obstacle, MAP_ROWS * sizeof(MapRow));
+    map_release(snapshot);
+}
+
+static int map_index(Map *map, int x, int y, int z) {
+    x -= map->dx;
+    z -= map->dz;
+    if (x < 0 || x >= MAP_SPAN || z < 0 || z >= MAP_SPAN ||
+        y < 0 || y >= CHUNK_HEIGHT)
+    {
+        return -1;
+    }
+    return (y * MAP_SPAN + z) * MAP_SPAN + x;
+}
+
+static int map_palette_index(Map *map, int w) {
+    for (int i = 0; i < map->palette_size; i++) {
+        if (map->palette[i] == w) {
+            return i;
         }
-        index = (index + 1) & map->mask;
-        entry = map->data + index;
     }
-    if (overwrite) {
-        entry->w = w;
+    if (map->palette_size == MAP_PALETTE_SIZE) {
+        return -1;
     }
-    else if (w) {
-        entry->x = x;
-        entry->y = y;
-        entry->z = z;
-        entry->w = w;
+    map->palette[map->palette_size] = w;
+    return map->palette_size++;
+}
+
+static int map_set_dense(Map *map, int x, int y, int z, int w) {
+    int index = map_index(map, x, y, z);
+    if (index < 0) {
+        return 0;
+    }
+    int value = map_palette_index(map, w);
+    if (value < 0) {
+        return 0;
+    }
+    unsigned char *block = map->blocks + index;
+    if (!*block && value) {
         map->size++;
-        if (map->size * 2 > map->mask) {
-            map_grow(map);
+    }
+    else if (*block && !value) {
+        map->size--;
+    }
+    *block = value;
+    if (value && y >= map->top) {
+        map->top = y + 1;
+    }
+    return 1;
+}
+
+// Packs chunk-local coordinates into an Entry key, 0 if out of bounds
+static unsigned int map_key(Map *map, int x, int y, int z) {
+    x -= map->dx;
+    z -= map->dz;
+    if (x < 0 || x >= MAP_SPAN || z < 0 || z >= MAP_SPAN ||
+        y < 0 || y >= CHUNK_HEIGHT)
+    {
+        return 0;
+    }
+    return MAP_KEY(x, y, z);
+}
+
+// Moves up to count slots of a pending resize into the new table. Only
+// slot indexes move; the entry list itself never needs rehashing.
+static void map_migrate(Map *map, unsigned int count) {
+    while (map->old_slots && count--) {
+        unsigned int index = map->old_slots[map->moved];
+        if (SLOT_LIVE(index)) {
+            unsigned int key = map->data[index - 1].key;
+            unsigned int *slot = map_probe(
+                map, map->slots, map->tags, map->mask, key);
+            if (*slot == SLOT_DELETED) {
+                map->deleted--;
+            }
+            *slot = index;
+            map_tag(map->slots, map->tags, slot, key);
+            // the new slot is the only live copy now: once the entry is
+            // removed or moved through it, the old one would be stale
+            slot = map->old_slots + map->moved;
+            *slot = SLOT_DELETED;
+            map_tag(map->old_slots, map->old_tags, slot, 0);
+        }
+        if (++map->moved > map->old_mask) {
+            pool_free(map->old_slots);
+            pool_free(map->old_tags);
+            map->old_slots = 0;
+            map->old_tags = 0;
         }
     }
 }
 
-int map_get(Map *map, int x, int y, int z) {
-    unsigned int index = hash(x, y, z) & map->mask;
-    Entry *entry = map->data + index;
-    while (!EMPTY_ENTRY(entry)) {
-        if (entry->x == x && entry->y == y && entry->z == z) {
-            return entry->w;
+// Looks key up in the new table, then in the part of the old table that
+// hasn't been migrated yet. Sets *old when the slot is in the old table.
+static unsigned int *map_find(Map *map, unsigned int key, int *old) {
+    unsigned int *slot = map_probe(
+        map, map->slots, map->tags, map->mask, key);
+    *old = 0;
+    if (!SLOT_LIVE(*slot) && map->old_slots) {
+        unsigned int *other = map_probe(
+            map, map->old_slots, map->old_tags, map->old_mask, key);
+        if (SLOT_LIVE(*other)) {
+            *old = 1;
+            return other;
         }
-        index = (index + 1) & map->mask;
-        entry = map->data + index;
     }
-    return 0;
+    return slot;
 }
 
+// Starts an incremental rehash into a fresh table, doubled if the live
+// entries need it, otherwise the same size to clear deleted slots
 void map_grow(Map *map) {
-    Map new_map;
-    new_map.mask = (map->mask << 1) | 1;
-    new_map.size = 0;
-    new_map.data = (Entry *)calloc(new_map.mask + 1, sizeof(Entry));
-    for (unsigned int index = 0; index <= map->mask; index++) {
-        Entry *entry = map->data + index;
-        if (!EMPTY_ENTRY(entry)) {
-            map_set(&new_map, entry->x, entry->y, entry->z, entry->w);
-        }
-    }
-    free(map->data);
-    map->mask = new_map.mask;
-    map->size = new_map.size;
-    map->data = new_map.data;
-}
-
-// Generate map on spawn - Generate chunks
-void make_world(Map *map, int p, int q) {
-    int pad = 1;
-    for (int dx = -pad; dx < CHUNK_SIZE + pad; dx++) {
-        for (int dz = -pad; dz < CHUNK_SIZE + pad; dz++) {
-            int x = p * CHUNK_SIZE + dx; // X axis
-            int z = q * CHUNK_SIZE + dz; // Z axis
-            float f = simplex2(x * 0.01, z * 0.01, 4, 0.5, 2);
-            float g = simplex2(-x * 0.01, -z * 0.01, 2, 0.9, 2);
-            int mh = g * 32 + 16;
-            int h = f * mh;
-            int w = 1;
-            int t = 12;
-            if (h <= t) {
-                h = t;
-                w = 2;
-            }
-            if (dx < 0 || dz < 0 || dx >= CHUNK_SIZE || dz >= CHUNK_SIZE) {
-                w = -1;
+    if (map->snapshot) {
+        map_unshare(map);
+    }
+    map_migrate(map, map->old_mask + 1);
+    map->old_mask = map->mask;
+    map->old_slots = map->slots;
+    map->old_tags = map->tags;
+    map->moved = 0;
+    if (map->size * 2 > MAP_LIMIT(map->mask)) {
+        map->mask = (map->mask << 1) | 1;
+        map->data = (Entry *)pool_realloc(
+            map->data, MAP_LIMIT(map->mask) * sizeof(Entry));
+    }
+    map->deleted = 0;
+    map->slots = (unsigned int *)pool_calloc(
+        map->mask + 1, sizeof(unsigned int));
+    map->tags = map_tags(map->mask);
+}
+
+// Deletes the entry in slot and moves the last entry into its place, so
+// the entry list stays dense
+static void map_remove(Map *map, unsigned int *slot, int old) {
+    unsigned int index = *slot - 1;
+    *slot = SLOT_DELETED;
+    if (old) {
+        map_tag(map->old_slots, map->old_tags, slot, 0);
+    }
+    else {
+        map_tag(map->slots, map->tags, slot, 0);
+        map->deleted++;
+    }
+    map->size--;
+    if (index != map->size) {
+        Entry *last = map->data + map->size;
+        *map_find(map, last->key, &old) = index + 1;
+        map->data[index] = *last;
+    }
+}
+
+static void map_insert(Map *map, unsigned int key, int w) {
+    map_migrate(map, MAP_MIGRATE);
+    int old;
+    unsigned int *slot = map_find(map, key, &old);
+    if (SLOT_LIVE(*slot)) {
+        if (w) {
+            map->data[*slot - 1].w = w;
+        }
+        else {
+            map_remove(map, slot, old);
+        }
+        return;
+    }
+    if (!w) {
+        return;
+    }
+    if (*slot == SLOT_DELETED) {
+        map->deleted--;
+    }
+    Entry *entry = map->data + map->size;
+    entry->key = key;
+    entry->w = w;
+    *slot = ++map->size;
+    map_tag(map->slots, map->tags, slot, key);
+    if (map->size + map->deleted >= MAP_LIMIT(map->mask)) {
+        map_grow(map);
+    }
+}
+
+// Highest y below the given one in the column holding an obstacle, or any
+// block at all, -1 if there is none
+static int map_scan(Map *map, int x, int y, int z, int obstacle) {
+    while (--y >= 0) {
+        int w = map_get(map, x, y, z);
+        if (obstacle ? is_obstacle(w) : w != 0) {
+            break;
+        }
+    }
+    return y;
+}
+
+static void map_update_masks(Map *map, int x, int y, int z, int w) {
+    MapRow bit = (MapRow)1 << (x - map->dx);
+    int i = y * MAP_SPAN + (z - map->dz);
+    if (is_transparent(w)) {
+        map->opaque[i] &= ~bit;
+    }
+    else {
+        map->opaque[i] |= bit;
+    }
+    if (is_obstacle(w)) {
+        map->obstacle[i] |= bit;
+    }
+    else {
+        map->obstacle[i] &= ~bit;
+    }
+}
+
+static void map_update_heights(Map *map, int x, int y, int z, int w) {
+    int i = (z - map->dz) * MAP_SPAN + (x - map->dx);
+    signed char *block = map->highest_block + i;
+    signed char *obstacle = map->highest_obstacle + i;
+    if (w && y > *block) {
+        *block = y;
+    }
+    else if (!w && y == *block) {
+        *block = map_scan(map, x, y, z, 0);
+    }
+    if (is_obstacle(w) && y > *obstacle) {
+        *obstacle = y;
+    }
+    else if (!is_obstacle(w) && y == *obstacle) {
+        *obstacle = map_scan(map, x, y, z, 1);
+    }
+}
+
+void map_set(Map *map, int x, int y, int z, int w) {
+    if (map_index(map, x, y, z) < 0) {
+        return;
+    }
+    if (map->snapshot) {
+        map_unshare(map);
+    }
+    if (map->dense) {
+        if (!map_set_dense(map, x, y, z, w)) {
+            return;
+        }
+    }
+    else {
+        unsigned int key = map_key(map, x, y, z);
+        if (!key) {
+            return;
+        }
+        map_insert(map, key, w);
+    }
+    map_update_masks(map, x, y, z, w);
+    map_update_heights(map, x, y, z, w);
+    map->version++;
+}
+
+int map_get(Map *map, int x, int y, int z) {
+    if (map->dense) {
+        int index = map_index(map, x, y, z);
+        return index < 0 ? 0 : map->palette[map->blocks[index]];
+    }
+    unsigned int key = map_key(map, x, y, z);
+    if (!key) {
+        return 0;
+    }
+    // shared tables are read only, map_find looks in both anyway
+    if (!map->snapshot) {
+        map_migrate(map, MAP_MIGRATE);
+    }
+    int old;
+    unsigned int *slot = map_find(map, key, &old);
+    return SLOT_LIVE(*slot) ? map->data[*slot - 1].w : 0;
+}
+
+static int map_column(Map *map, int x, int z) {
+    x -= map->dx;
+    z -= map->dz;
+    if (x < 0 || x >= MAP_SPAN || z < 0 || z >= MAP_SPAN) {
+        return -1;
+    }
+    return z * MAP_SPAN + x;
+}
+
+int map_highest_obstacle(Map *map, int x, int z) {
+    int i = map_column(map, x, z);
+    return i < 0 ? -1 : map->highest_obstacle[i];
+}
+
+int map_highest_block(Map *map, int x, int z) {
+    int i = map_column(map, x, z);
+    return i < 0 ? -1 : map->highest_block[i];
+}
+
+// Exposed face masks for the row of blocks at (y, z), bit i standing for
+// local x = i, in the order left, right, top, bottom, front, back. A face
+// is exposed when the neighbour on that side is transparent; the bottom
+// face of y = 0 never is. Faces on the chunk border look into neighbours,
+// indexed by MAP_LEFT etc, and count as exposed where that is null.
+void map_row_faces(Map *map, Map **neighbours, int y, int z, MapRow *faces) {
+    z -= map->dz;
+    if (y < 0 || y >= CHUNK_HEIGHT || z < 0 || z >= MAP_SPAN) {
+        for (int i = 0; i < 6; i++) {
+            faces[i] = 0;
+        }
+        return;
+    }
+    int i = y * MAP_SPAN + z;
+    MapRow *row = map->opaque + i;
+    MapRow left = *row << 1;
+    MapRow right = *row >> 1;
+    Map *other = neighbours[MAP_LEFT];
+    if (other) {
+        left |= other->opaque[i] >> (MAP_SPAN - 1) & 1;
+    }
+    other = neighbours[MAP_RIGHT];
+    if (other) {
+        right |= (other->opaque[i] & 1) << (MAP_SPAN - 1);
+    }
+    faces[0] = ~left;
+    faces[1] = ~right;
+    faces[2] = y + 1 < CHUNK_HEIGHT ? ~row[MAP_SPAN] : ~(MapRow)0;
+    faces[3] = y > 0 ? ~row[-MAP_SPAN] : 0;
+    if (z + 1 < MAP_SPAN) {
+        faces[4] = ~row[1];
+    }
+    else {
+        other = neighbours[MAP_FRONT];
+        faces[4] = other ? ~other->opaque[y * MAP_SPAN] : ~(MapRow)0;
+    }
+    if (z > 0) {
+        faces[5] = ~row[-1];
+    }
+    else {
+        other = neighbours[MAP_BACK];
+        faces[5] = other ?
+            ~other->opaque[i + MAP_SPAN - 1] : ~(MapRow)0;
+    }
+}
+
+// Compact form of a dense map: palette size and top, the palette, then the
+// block indices up to top as (run length, index) byte pairs. Only meant to
+// be read back on the same machine. Returns the length, 0 for hash maps.
+int map_encode(Map *map, unsigned char *data) {
+    if (!map->dense) {
+        return 0;
+    }
+    int header[2] = {map->palette_size, map->top};
+    memcpy(data, header, sizeof(header));
+    int length = sizeof(header);
+    memcpy(data + length, map->palette, map->palette_size * sizeof(int));
+    length += map->palette_size * sizeof(int);
+    int count = MAP_LAYER * map->top;
+    int i = 0;
+    while (i < count) {
+        unsigned char value = map->blocks[i];
+        int run = 1;
+        while (run < 255 && i + run < count && map->blocks[i + run] == value) {
+            run++;
+        }
+        data[length++] = run;
+        data[length++] = value;
+        i += run;
+    }
+    return length;
+}
+
+// Reads map_encode output into a freshly allocated dense map and rebuilds
+// the masks and column heights in one pass. Returns 0 if data is malformed,
+// in which case the map should be freed.
+int map_decode(Map *map, const unsigned char *data, int size) {
+    int header[2];
+    if (!map->dense || size < (int)sizeof(header)) {
+        return 0;
+    }
+    memcpy(header, data, sizeof(header));
+    int palette_size = header[0];
+    int top = header[1];
+    int length = sizeof(header) + palette_size * sizeof(int);
+    if (palette_size < 1 || palette_size > MAP_PALETTE_SIZE ||
+        top < 0 || top > CHUNK_HEIGHT || size < length)
+    {
+        return 0;
+    }
+    memcpy(map->palette, data + sizeof(header), palette_size * sizeof(int));
+    int count = MAP_LAYER * top;
+    int i = 0;
+    while (i < count && length + 2 <= size) {
+        int run = data[length++];
+        int value = data[length++];
+        if (!run || i + run > count || value >= palette_size) {
+            return 0;
+        }
+        memset(map->blocks + i, value, run);
+        i += run;
+    }
+    if (i != count || length != size) {
+        return 0;
+    }
+    map->palette_size = palette_size;
+    map->top = top;
+
+    char opaque[MAP_PALETTE_SIZE];
+    char obstacle[MAP_PALETTE_SIZE];
+    for (int k = 0; k < palette_size; k++) {
+        opaque[k] = !is_transparent(map->palette[k]);
+        obstacle[k] = is_obstacle(map->palette[k]);
+    }
+    map->size = 0;
+    for (int row = 0; row < MAP_SPAN * top; row++) {
+        unsigned char *blocks = map->blocks + row * MAP_SPAN;
+        int y = row / MAP_SPAN;
+        int z = row % MAP_SPAN;
+        MapRow opaque_row = 0;
+        MapRow obstacle_row = 0;
+        for (int x = 0; x < MAP_SPAN; x++) {
+            int value = blocks[x];
+            if (!value) {
+                continue;
             }
-            
-            // grass gen
-            for (int y = 0; y < h; y++) {
-                map_set(map, x, y, z, w);
+            map->size++;
+            opaque_row |= (MapRow)opaque[value] << x;
+            obstacle_row |= (MapRow)obstacle[value] << x;
+            // rows go up in y, so the last block seen is the highest
+            map->highest_block[z * MAP_SPAN + x] = y;
+            if (obstacle[value]) {
+                map->highest_obstacle[z * MAP_SPAN + x] = y;
             }
-            
-            // Complete trees!
-            int open_confirm = 1;
-            if(dx - 3 < 0 || dz - 3 < 0 || dx + 4 >= CHUNK_SIZE || dz + 4 >= CHUNK_SIZE) {
-				open_confirm = 0;
-			}
-			
-			if(open_confirm && simplex2(x, z, 6, 0.5, 2) > 0.84) {
-				for (int y = h + 3; y < h + 8; y++) {
-					for (int ox = -3; ox <= 3; ox++) {
-						for (int oz = -3; oz <= 3; oz++) {
-						int d = (ox * ox) + (oz * oz) + (y - (h + 4)) * (y - (h + 4));
-							if (d < 11) {
-								map_set(map, x + ox, y, z + oz, 7);
-							}
-						}
-					}
-				}
-				for (int y = h; y < h + 7; y++) {
-					map_set(map, x, y, z, 5);
-				}
-			}
-			
-			// Gen plants
-			if(w == 1 && simplex2(x * 0.1, z * 0.15, 4, 0.5, 2) > 0.76) {
-				map_set(map, x, h, z, 17); // write plants to map
-			}
-			
-			// Gen long grass
-			if(w == 1 && simplex2(x * 0.2, z * 0.3, 4, 0.5, 2) > 0.68) {
-				map_set(map, x, h, z, 18); // write long grass to map
-			}
-			
-			// NEW - Tall grass biomes
-			// Gen tall grass biomes
-			if(w == 1 && simplex2(x * 0.014, z * 0.025, 6, 0.5, 2) > 0.78) {
-				map_set(map, x, h, z, 18);
-				map_set(map, x, h+1, z, 18);
-				
-				// Get the grass to generate at different heights
-				int check = random_number(0,1);
-				if(check) {
-					map_set(map, x, h+2, z, 18);
-				}
-			}
-			
-			
-			// Gen clouds
-			for(int y = 70; y < 78; y++) {
-				if(simplex3(x * 0.014, y * 0.1, z * 0.014, 6, 0.5, 2) > 0.70) {
-					map_set(map, x, y, z, 32); // write clouds to map
-				}
-			}
-        }
-    }
-    db_update_chunk(map, p, q);
+        }
+        map->opaque[row] = opaque_row;
+        map->obstacle[row] = obstacle_row;
+    }
+    map->version++;
+    return 1;
 }
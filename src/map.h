@@ -1,34 +1,154 @@
 #ifndef _map_h_
 #define _map_h_
 
-#define EMPTY_ENTRY(e) (!(e)->x && !(e)->y && !(e)->z && !(e)->w)
+#define CHUNK_SIZE 32
+#define CHUNK_HEIGHT 128
 
-#define MAP_FOR_EACH(map, entry) \
-    for (unsigned int i = 0; i <= map->mask; i++) { \
-        Entry *entry = map->data + i; \
-        if (EMPTY_ENTRY(entry)) { \
+// Chunk storage covers exactly one chunk; faces on its border are culled
+// against the neighbouring chunks, see map_row_faces
+#define MAP_SPAN CHUNK_SIZE
+#define MAP_LAYER (MAP_SPAN * MAP_SPAN)
+#define MAP_PALETTE_SIZE 256
+
+// One bit per block along x for each (y, z) row of the footprint
+#define MAP_ROWS (CHUNK_HEIGHT * MAP_SPAN)
+
+// Upper bound on the bytes map_encode writes: a header, the palette and
+// one (run, index) byte pair per block at worst
+#define MAP_ENCODED_SIZE \
+    (8 + MAP_PALETTE_SIZE * 4 + MAP_LAYER * CHUNK_HEIGHT * 2)
+
+// Slots moved from the old table on each map_set/map_get while growing
+#define MAP_MIGRATE 16
+
+// Build with -DMAP_GROUPS=1 for the group-probing hash backend: a byte tag
+// per slot, matched 16 at a time with SSE2, filled up to 7/8 load
+#ifndef MAP_GROUPS
+#define MAP_GROUPS 0
+#endif
+
+// Entry keys pack chunk-local x, z and y into the low three bytes and set
+// the top byte, so a valid key is never 0 even at local (0, 0, 0)
+#define MAP_KEY(x, y, z) (0x1000000u | (y) << 16 | (z) << 8 | (x))
+#define KEY_X(key) ((key) & 0xff)
+#define KEY_Y(key) (((key) >> 16) & 0xff)
+#define KEY_Z(key) (((key) >> 8) & 0xff)
+
+#define MAP_FOR_EACH(map, ex, ey, ez, ew) \
+    for (unsigned int i = 0; i < map_slots(map); i++) { \
+        int ex, ey, ez, ew; \
+        if (!map_slot(map, i, &ex, &ey, &ez, &ew)) { \
             continue; \
         }
 
 #define END_MAP_FOR_EACH }
 
 typedef struct {
-    int x;
-    int y;
-    int z;
+    unsigned int key;
     int w;
 } Entry;
 
+typedef unsigned long long MapRow;
+
+typedef struct MapSnapshot MapSnapshot;
+
+// Sides of a chunk, indexing the neighbours passed to map_row_faces
+#define MAP_LEFT 0
+#define MAP_RIGHT 1
+#define MAP_BACK 2
+#define MAP_FRONT 3
+
 typedef struct {
+    int dx;
+    int dz;
     unsigned int mask;
     unsigned int size;
+    unsigned int deleted;
+    // live entries, kept dense, indexed by the hash table slots
     Entry *data;
+    unsigned int *slots;
+    unsigned char *tags;
+    // pending incremental resize, see map_grow
+    unsigned int old_mask;
+    unsigned int moved;
+    unsigned int *old_slots;
+    unsigned char *old_tags;
+    // dense chunk storage, see map_alloc_chunk
+    int dense;
+    int top;
+    int palette_size;
+    int *palette;
+    unsigned char *blocks;
+    // MAP_SPAN x MAP_SPAN column heights, kept current by map_set
+    signed char *highest_obstacle;
+    signed char *highest_block;
+    // MAP_ROWS bit rows of opaque blocks and of obstacles
+    MapRow *opaque;
+    MapRow *obstacle;
+    // bumped by every map_set, see map_snapshot
+    unsigned int version;
+    MapSnapshot *snapshot;
 } Map;
 
-void map_alloc(Map *map);
+// Immutable view of a Map as of map.version, safe to read from other threads
+// with the usual map functions on &snapshot->map until map_release
+struct MapSnapshot {
+    Map map;
+    int refs;
+};
+
+void map_alloc(Map *map, int p, int q);
+void map_alloc_chunk(Map *map, int p, int q);
 void map_free(Map *map);
+MapSnapshot *map_snapshot(Map *map);
+void map_release(MapSnapshot *snapshot);
 void map_set(Map *map, int x, int y, int z, int w);
+void map_grow(Map *map);
 int map_get(Map *map, int x, int y, int z);
-void make_world(Map *map, int p, int q);
+int map_highest_obstacle(Map *map, int x, int z);
+int map_highest_block(Map *map, int x, int z);
+void map_row_faces(Map *map, Map **neighbours, int y, int z, MapRow *faces);
+int map_encode(Map *map, unsigned char *data);
+int map_decode(Map *map, const unsigned char *data, int size);
+
+static inline unsigned int map_slots(Map *map) {
+    if (map->dense) {
+        return MAP_LAYER * map->top;
+    }
+    return map->size;
+}
+
+static inline int map_slot(
+    Map *map, unsigned int i, int *x, int *y, int *z, int *w)
+{
+    if (map->dense) {
+        int index = map->blocks[i];
+        if (!index) {
+            return 0;
+        }
+        *x = map->dx + i % MAP_SPAN;
+        *y = i / MAP_LAYER;
+        *z = map->dz + i / MAP_SPAN % MAP_SPAN;
+        *w = map->palette[index];
+        return 1;
+    }
+    Entry *entry = map->data + i;
+    *x = map->dx + KEY_X(entry->key);
+    *y = KEY_Y(entry->key);
+    *z = map->dz + KEY_Z(entry->key);
+    *w = entry->w;
+    return 1;
+}
+
+static inline int map_obstacle(Map *map, int x, int y, int z) {
+    x -= map->dx;
+    z -= map->dz;
+    if (x < 0 || x >= MAP_SPAN || z < 0 || z >= MAP_SPAN ||
+        y < 0 || y >= CHUNK_HEIGHT)
+    {
+        return 0;
+    }
+    return map->obstacle[y * MAP_SPAN + z] >> x & 1;
+}
 
 #endif
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map.h"
+
+// Randomized check of the hash backend against a plain array: blocks are
+// set, replaced and removed while map_grow keeps a resize pending, and
+// after every step map_get, the size and MAP_FOR_EACH must agree with the
+// array. Every trial runs; a failing one reports its first mismatch and
+// the test exits non-zero if any failed.
+
+#define TRIALS 256
+#define STEPS 20000
+#define KEYS 4096 // distinct blocks touched, a slice of one chunk
+
+static int reference[KEYS];
+static int frozen[KEYS];
+
+static void key_block(Map *map, int key, int *x, int *y, int *z) {
+    *x = map->dx + key % MAP_SPAN;
+    *z = map->dz + key / MAP_SPAN % MAP_SPAN;
+    *y = key / MAP_LAYER;
+}
+
+static int check(Map *map, const int *expected, int trial, int step) {
+    int size = 0;
+    for (int key = 0; key < KEYS; key++) {
+        int x, y, z;
+        key_block(map, key, &x, &y, &z);
+        int w = map_get(map, x, y, z);
+        if (w != expected[key]) {
+            printf("trial %d step %d: block %d,%d,%d is %d, expected %d\n",
+                trial, step, x, y, z, w, expected[key]);
+            return 0;
+        }
+        size += expected[key] != 0;
+    }
+    int count = 0;
+    MAP_FOR_EACH(map, ex, ey, ez, ew) {
+        int key = (ey * MAP_SPAN + ez - map->dz) * MAP_SPAN + ex - map->dx;
+        if (key < 0 || key >= KEYS || expected[key] != ew) {
+            printf("trial %d step %d: stray block %d,%d,%d = %d\n",
+                trial, step, ex, ey, ez, ew);
+            return 0;
+        }
+        count++;
+    } END_MAP_FOR_EACH;
+    if (count != size || (int)map->size != size) {
+        printf("trial %d step %d: %d blocks iterated, size %u, expected %d\n",
+            trial, step, count, map->size, size);
+        return 0;
+    }
+    return 1;
+}
+
+static int run_trial(int trial) {
+    Map map;
+    map_alloc(&map, trial % 7 - 3, trial % 5 - 2);
+    for (int key = 0; key < KEYS; key++) {
+        reference[key] = 0;
+    }
+    int last = 0;
+    for (int step = 0; step < STEPS; step++) {
+        int key = rand() % KEYS;
+        int action = rand() % 16;
+        int w = action < 8 ? 0 : 1 + rand() % 8;
+        if (action < 3) {
+            // the newest entry sits last in the entry list, so removing it
+            // leaves its key behind past the live entries, and adding it
+            // back right away reuses that spot
+            key = last;
+            w = action == 0 ? 0 : reference[key] ? 0 : 1 + rand() % 8;
+        }
+        int x, y, z;
+        key_block(&map, key, &x, &y, &z);
+        if (action == 3) {
+            // start another resize on top of whatever is pending
+            map_grow(&map);
+            continue;
+        }
+        // removals about as often as sets, so keys get re-added while
+        // their slots are still being migrated
+        if (w && !reference[key]) {
+            last = key;
+        }
+        map_set(&map, x, y, z, w);
+        reference[key] = w;
+        if ((step % 97 == 0 || step == STEPS - 1) &&
+            !check(&map, reference, trial, step))
+        {
+            map_free(&map);
+            return 0;
+        }
+    }
+    map_free(&map);
+    return 1;
+}
+
+static void set_random(Map *map, int *expected) {
+    int key = rand() % KEYS;
+    int w = rand() % 2 ? 0 : 1 + rand() % 8;
+    int x, y, z;
+    key_block(map, key, &x, &y, &z);
+    map_set(map, x, y, z, w);
+    expected[key] = w;
+}
+
+// A snapshot taken with some blocks set must keep reading those blocks and
+// its version while the live map is changed and grown under it. Hash maps
+// take it with a resize pending, so the old table is shared too. Once the
+// snapshot is released, the next map_set takes the buffers back without
+// copying them.
+static int run_snapshot(int trial, int dense) {
+    Map map;
+    if (dense) {
+        map_alloc_chunk(&map, trial % 7 - 3, trial % 5 - 2);
+    }
+    else {
+        map_alloc(&map, trial % 7 - 3, trial % 5 - 2);
+    }
+    for (int key = 0; key < KEYS; key++) {
+        reference[key] = 0;
+    }
+    for (int step = 0; step < KEYS; step++) {
+        set_random(&map, reference);
+    }
+    if (!dense) {
+        map_grow(&map);
+        if (!map.old_slots) {
+            printf("trial %d: no resize pending\n", trial);
+            map_free(&map);
+            return 0;
+        }
+    }
+    MapSnapshot *snapshot = map_snapshot(&map);
+    unsigned int version = map.version;
+    MapRow *opaque = map.opaque;
+    for (int key = 0; key < KEYS; key++) {
+        frozen[key] = reference[key];
+    }
+    int ok = 1;
+    for (int step = 0; ok && step < STEPS / 10; step++) {
+        if (!dense && step % 1000 == 0) {
+            map_grow(&map);
+        }
+        set_random(&map, reference);
+        if (step % 97 == 0) {
+            ok = check(&snapshot->map, frozen, trial, step) &&
+                check(&map, reference, trial, step);
+        }
+    }
+    if (ok && (snapshot->map.version != version || map.version == version ||
+        map.opaque == opaque || snapshot->map.opaque != opaque))
+    {
+        printf("trial %d: snapshot version %u, live %u, taken at %u\n",
+            trial, snapshot->map.version, map.version, version);
+        ok = 0;
+    }
+    map_release(snapshot);
+
+    // the map holds the only reference left, so its buffers are kept
+    if (ok) {
+        map_release(map_snapshot(&map));
+        opaque = map.opaque;
+        set_random(&map, reference);
+        if (map.snapshot || map.opaque != opaque) {
+            printf("trial %d: buffers copied after the last release\n",
+                trial);
+            ok = 0;
+        }
+    }
+    ok = ok && check(&map, reference, trial, STEPS);
+    map_free(&map);
+    return ok;
+}
+
+// map_decode must rebuild exactly the map map_encode was given, masks and
+// column heights included, and refuse data cut short or naming a palette
+// entry that doesn't exist
+static int run_encode(int trial) {
+    Map map, copy;
+    map_alloc_chunk(&map, trial % 7 - 3, trial % 5 - 2);
+    for (int key = 0; key < KEYS; key++) {
+        reference[key] = 0;
+    }
+    for (int step = 0; step < KEYS * (trial % 4); step++) {
+        set_random(&map, reference);
+    }
+    unsigned char *data = (unsigned char *)malloc(MAP_ENCODED_SIZE);
+    int length = map_encode(&map, data);
+    map_alloc_chunk(&copy, trial % 7 - 3, trial % 5 - 2);
+    int ok = length > 0 && map_decode(&copy, data, length);
+    if (!ok) {
+        printf("trial %d: %d encoded bytes not decoded\n", trial, length);
+    }
+    ok = ok && check(&copy, reference, trial, 0);
+    if (ok && (copy.top != map.top ||
+        memcmp(copy.opaque, map.opaque, MAP_ROWS * sizeof(MapRow)) ||
+        memcmp(copy.obstacle, map.obstacle, MAP_ROWS * sizeof(MapRow)) ||
+        memcmp(copy.highest_block, map.highest_block, MAP_LAYER) ||
+        memcmp(copy.highest_obstacle, map.highest_obstacle, MAP_LAYER)))
+    {
+        printf("trial %d: decoded masks or heights differ\n", trial);
+        ok = 0;
+    }
+    map_free(&copy);
+
+    // every shorter prefix is malformed
+    for (int cut = 0; ok && cut < length; cut += 1 + cut / 8) {
+        map_alloc_chunk(&copy, 0, 0);
+        if (map_decode(&copy, data, cut)) {
+            printf("trial %d: decoded %d of %d bytes\n", trial, cut, length);
+            ok = 0;
+        }
+        map_free(&copy);
+    }
+
+    // the first run names one past the palette
+    int header = 2 * sizeof(int) + map.palette_size * sizeof(int);
+    if (ok && length > header) {
+        data[header + 1] = map.palette_size;
+        map_alloc_chunk(&copy, 0, 0);
+        if (map_decode(&copy, data, length)) {
+            printf("trial %d: decoded a bad palette index\n", trial);
+            ok = 0;
+        }
+        map_free(&copy);
+    }
+
+    Map hash;
+    map_alloc(&hash, 0, 0);
+    if (ok && map_encode(&hash, data)) {
+        printf("trial %d: encoded a hash map\n", trial);
+        ok = 0;
+    }
+    map_free(&hash);
+    free(data);
+    map_free(&map);
+    return ok;
+}
+
+int main() {
+    srand(1);
+    int failed = 0;
+    for (int trial = 0; trial < TRIALS; trial++) {
+        failed += !run_trial(trial);
+    }
+    printf("%s: %d/%d trials failed\n",
+        MAP_GROUPS ? "hash_groups" : "hash", failed, TRIALS);
+    int snapshot_failed = 0;
+    for (int trial = 0; trial < TRIALS / 4; trial++) {
+        snapshot_failed += !run_snapshot(trial, trial % 2);
+    }
+    printf("snapshot: %d/%d trials failed\n", snapshot_failed, TRIALS / 4);
+    int encode_failed = 0;
+    for (int trial = 0; trial < TRIALS / 4; trial++) {
+        encode_failed += !run_encode(trial);
+    }
+    printf("encode: %d/%d trials failed\n", encode_failed, TRIALS / 4);
+    return failed || snapshot_failed || encode_failed;
+}
@@ -1,4 +1,6 @@
 #include <math.h>
+#include <string.h>
+#include "noise.h"
 
 #define F2 0.3660254037844386f
 #define G2 0.21132486540518713f
@@ -190,10 +192,18 @@ float noise3(float x, float y, float z) {
     return (noise[0] + noise[1] + noise[2] + noise[3]) * 32.0f;
 }
 
+static __thread NoiseStats stats;
+
+void noise_stats(NoiseStats *result) {
+    *result = stats;
+}
+
 float simplex2(
     float x, float y,
     int octaves, float persistence, float lacunarity)
 {
+    stats.samples2++;
+    stats.octaves2 += octaves;
     float freq = 1.0f;
     float amp = 1.0f;
     float max = 1.0f;
@@ -208,10 +218,68 @@ float simplex2(
     return (1 + total / max) / 2;
 }
 
+// |noise2| stays below 1 (0.998 at most), so after each octave the
+// remaining ones move the total by less than their summed amplitude. The
+// margin covers rounding in that sum; closer calls run every octave and
+// decide exactly like simplex2.
+#define NOISE2_BOUND 1.0f
+#define NOISE_MARGIN 1e-3f
+
+// Largest float not above threshold, so v > limit matches v > threshold
+// for every float v
+static float noise_limit(double threshold) {
+    float limit = threshold;
+    return limit > threshold ? nextafterf(limit, -1.0f) : limit;
+}
+
+static float noise_max(int octaves, float persistence) {
+    float amp = 1.0f;
+    float max = 1.0f;
+    for (int i = 1; i < octaves; i++) {
+        amp *= persistence;
+        max += amp;
+    }
+    return max;
+}
+
+int simplex2_above(
+    float x, float y, double threshold,
+    int octaves, float persistence, float lacunarity)
+{
+    float limit = noise_limit(threshold);
+    float max = noise_max(octaves, persistence);
+    float need = (2 * limit - 1) * max;
+    float left = max - 1.0f;
+    float freq = 1.0f;
+    float amp = 1.0f;
+    float total = noise2(x, y);
+    int i;
+    for (i = 1; i < octaves; i++) {
+        if (total + left * NOISE2_BOUND < need - NOISE_MARGIN) {
+            break;
+        }
+        if (total - left * NOISE2_BOUND > need + NOISE_MARGIN) {
+            break;
+        }
+        freq *= lacunarity;
+        amp *= persistence;
+        left -= amp;
+        total += noise2(x * freq, y * freq) * amp;
+    }
+    stats.samples2++;
+    stats.octaves2 += i;
+    if (i < octaves) {
+        return total > need;
+    }
+    return (1 + total / max) / 2 > limit;
+}
+
 float simplex3(
     float x, float y, float z,
     int octaves, float persistence, float lacunarity)
 {
+    stats.samples3++;
+    stats.octaves3 += octaves;
     float freq = 1.0f;
     float amp = 1.0f;
     float max = 1.0f;
@@ -225,3 +293,120 @@ float simplex3(
     }
     return (1 + total / max) / 2;
 }
+
+#if NOISE_SIMD
+
+typedef float vf4 __attribute__((vector_size(16)));
+typedef int vi4 __attribute__((vector_size(16)));
+#define VF vf4
+#define VI vi4
+#define W 4
+#define TARGET
+#define FN(name) name##_4
+#include "noise_simd.h"
+#undef VF
+#undef VI
+#undef W
+#undef TARGET
+#undef FN
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NOISE_AVX2 1
+typedef float vf8 __attribute__((vector_size(32)));
+typedef int vi8 __attribute__((vector_size(32)));
+#define VF vf8
+#define VI vi8
+#define W 8
+#define TARGET __attribute__((target("avx2")))
+#define FN(name) name##_8
+#include "noise_simd.h"
+#undef VF
+#undef VI
+#undef W
+#undef TARGET
+#undef FN
+
+static int noise_avx2() {
+    static int supported = -1;
+    if (supported < 0) {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return supported;
+}
+#endif
+
+#endif
+
+void simplex2_batch(
+    const float *x, const float *y, int n, float *out,
+    int octaves, float persistence, float lacunarity)
+{
+    int done = 0;
+#if NOISE_SIMD
+#ifdef NOISE_AVX2
+    if (noise_avx2()) {
+        done = simplex2_batch_8(
+            x, y, n, out, octaves, persistence, lacunarity);
+    }
+#endif
+    done += simplex2_batch_4(x + done, y + done, n - done, out + done,
+        octaves, persistence, lacunarity);
+#endif
+    // the scalar calls below count themselves
+    stats.samples2 += done;
+    stats.octaves2 += (unsigned long)done * octaves;
+    for (int i = done; i < n; i++) {
+        out[i] = simplex2(x[i], y[i], octaves, persistence, lacunarity);
+    }
+}
+
+void simplex2_above_batch(
+    const float *x, const float *y, int n, char *out, double threshold,
+    int octaves, float persistence, float lacunarity)
+{
+    int done = 0;
+#if NOISE_SIMD
+    float limit = noise_limit(threshold);
+    float max = noise_max(octaves, persistence);
+    unsigned long summed = 0;
+#ifdef NOISE_AVX2
+    if (noise_avx2()) {
+        done = simplex2_above_batch_8(x, y, n, out, limit, max,
+            octaves, persistence, lacunarity, &summed);
+    }
+#endif
+    done += simplex2_above_batch_4(x + done, y + done, n - done, out + done,
+        limit, max, octaves, persistence, lacunarity, &summed);
+    stats.samples2 += done;
+    stats.octaves2 += summed;
+#endif
+    for (int i = done; i < n; i++) {
+        out[i] = simplex2_above(
+            x[i], y[i], threshold, octaves, persistence, lacunarity);
+    }
+}
+
+void simplex3_batch(
+    const float *x, const float *y, const float *z, int n, float *out,
+    int octaves, float persistence, float lacunarity)
+{
+    int done = 0;
+#if NOISE_SIMD
+#ifdef NOISE_AVX2
+    if (noise_avx2()) {
+        done = simplex3_batch_8(
+            x, y, z, n, out, octaves, persistence, lacunarity);
+    }
+#endif
+    done += simplex3_batch_4(
+        x + done, y + done, z + done, n - done, out + done,
+        octaves, persistence, lacunarity);
+#endif
+    stats.samples3 += done;
+    stats.octaves3 += (unsigned long)done * octaves;
+    for (int i = done; i < n; i++) {
+        out[i] = simplex3(
+            x[i], y[i], z[i], octaves, persistence, lacunarity);
+    }
+}
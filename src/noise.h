@@ -1,6 +1,26 @@
 #ifndef _noise_h_
 #define _noise_h_
 
+// Build with -DNOISE_SIMD=0 to evaluate batches with the scalar code only.
+// Otherwise batches run 8 wide with AVX2 when the CPU has it, else 4 wide.
+#ifndef NOISE_SIMD
+#if defined(__GNUC__)
+#define NOISE_SIMD 1
+#else
+#define NOISE_SIMD 0
+#endif
+#endif
+
+// Points evaluated and octaves summed on the calling thread so far
+typedef struct {
+    unsigned long samples2;
+    unsigned long octaves2;
+    unsigned long samples3;
+    unsigned long octaves3;
+} NoiseStats;
+
+void noise_stats(NoiseStats *stats);
+
 float simplex2(
     float x, float y,
     int octaves, float persistence, float lacunarity);
@@ -9,4 +29,23 @@ float simplex3(
     float x, float y, float z,
     int octaves, float persistence, float lacunarity);
 
+// simplex2(...) > threshold, but stops summing octaves as soon as the ones
+// left can no longer change the answer
+int simplex2_above(
+    float x, float y, double threshold,
+    int octaves, float persistence, float lacunarity);
+
+// Evaluate n points at once into out, same results as the calls above
+void simplex2_batch(
+    const float *x, const float *y, int n, float *out,
+    int octaves, float persistence, float lacunarity);
+
+void simplex3_batch(
+    const float *x, const float *y, const float *z, int n, float *out,
+    int octaves, float persistence, float lacunarity);
+
+void simplex2_above_batch(
+    const float *x, const float *y, int n, char *out, double threshold,
+    int octaves, float persistence, float lacunarity);
+
 #endif
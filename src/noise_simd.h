@@ -0,0 +1,210 @@
+// Vector versions of noise2/noise3 and the octave sums, included by noise.c
+// once per width. The includer defines VF and VI (float and int vectors of
+// W lanes), TARGET (the ISA attribute) and FN(name) to suffix every symbol.
+// Arithmetic mirrors the scalar code operation for operation so results
+// agree with it.
+
+static TARGET VF FN(vfloor)(VF x) {
+    VF t = __builtin_convertvector(__builtin_convertvector(x, VI), VF);
+    return t + __builtin_convertvector(t > x, VF);
+}
+
+static TARGET VF FN(vselect)(VI mask, VF x) {
+    return (VF)(mask & (VI)x);
+}
+
+static TARGET VF FN(noise2)(VF x, VF y) {
+    VF s = (x + y) * F2;
+    VF i = FN(vfloor)(x + s);
+    VF j = FN(vfloor)(y + s);
+    VF t = (i + j) * G2;
+
+    VF xx[3], yy[3], gx[3], gy[3];
+    xx[0] = x - (i - t);
+    yy[0] = y - (j - t);
+
+    VI i1 = -(xx[0] > yy[0]);
+    VI j1 = 1 - i1;
+
+    xx[2] = xx[0] + G2 * 2.0f - 1.0f;
+    yy[2] = yy[0] + G2 * 2.0f - 1.0f;
+    xx[1] = xx[0] - __builtin_convertvector(i1, VF) + G2;
+    yy[1] = yy[0] - __builtin_convertvector(j1, VF) + G2;
+
+    VI I = __builtin_convertvector(i, VI) & 255;
+    VI J = __builtin_convertvector(j, VI) & 255;
+    for (int l = 0; l < W; l++) {
+        int g[3];
+        g[0] = PERM[I[l] + PERM[J[l]]] % 12;
+        g[1] = PERM[I[l] + i1[l] + PERM[J[l] + j1[l]]] % 12;
+        g[2] = PERM[I[l] + 1 + PERM[J[l] + 1]] % 12;
+        for (int c = 0; c <= 2; c++) {
+            gx[c][l] = GRAD3[g[c]][0];
+            gy[c][l] = GRAD3[g[c]][1];
+        }
+    }
+
+    VF noise[3];
+    for (int c = 0; c <= 2; c++) {
+        VF f = 0.5f - xx[c] * xx[c] - yy[c] * yy[c];
+        noise[c] = FN(vselect)(f > 0,
+            f * f * f * f * (gx[c] * xx[c] + gy[c] * yy[c]));
+    }
+    return (noise[0] + noise[1] + noise[2]) * 70.0f;
+}
+
+static TARGET VF FN(noise3)(VF x, VF y, VF z) {
+    VF s = (x + y + z) * F3;
+    VF i = FN(vfloor)(x + s);
+    VF j = FN(vfloor)(y + s);
+    VF k = FN(vfloor)(z + s);
+    VF t = (i + j + k) * G3;
+
+    VF pos[4][3], grad[4][3];
+    pos[0][0] = x - (i - t);
+    pos[0][1] = y - (j - t);
+    pos[0][2] = z - (k - t);
+
+    // the same corner order as the branches in noise3, ties included
+    VI a = pos[0][0] >= pos[0][1];
+    VI b = pos[0][1] >= pos[0][2];
+    VI c = pos[0][0] >= pos[0][2];
+    VI o1[3], o2[3];
+    o1[0] = a & (b | c) & 1;
+    o1[1] = ~a & b & 1;
+    o1[2] = ~b & ~(a & c) & 1;
+    o2[0] = (a | (b & c)) & 1;
+    o2[1] = (~a | b) & 1;
+    o2[2] = (~b | (~a & ~c)) & 1;
+
+    for (int d = 0; d <= 2; d++) {
+        pos[3][d] = pos[0][d] - 1.0f + 3.0f * G3;
+        pos[2][d] = pos[0][d] - __builtin_convertvector(o2[d], VF) +
+            2.0f * G3;
+        pos[1][d] = pos[0][d] - __builtin_convertvector(o1[d], VF) + G3;
+    }
+
+    VI I = __builtin_convertvector(i, VI) & 255;
+    VI J = __builtin_convertvector(j, VI) & 255;
+    VI K = __builtin_convertvector(k, VI) & 255;
+    for (int l = 0; l < W; l++) {
+        int g[4];
+        g[0] = PERM[I[l] + PERM[J[l] + PERM[K[l]]]] % 12;
+        g[1] = PERM[I[l] + o1[0][l] +
+            PERM[J[l] + o1[1][l] + PERM[o1[2][l] + K[l]]]] % 12;
+        g[2] = PERM[I[l] + o2[0][l] +
+            PERM[J[l] + o2[1][l] + PERM[o2[2][l] + K[l]]]] % 12;
+        g[3] = PERM[I[l] + 1 + PERM[J[l] + 1 + PERM[K[l] + 1]]] % 12;
+        for (int e = 0; e <= 3; e++) {
+            for (int d = 0; d <= 2; d++) {
+                grad[e][d][l] = GRAD3[g[e]][d];
+            }
+        }
+    }
+
+    VF noise[4];
+    for (int e = 0; e <= 3; e++) {
+        VF f = 0.6f - pos[e][0] * pos[e][0] - pos[e][1] * pos[e][1] -
+            pos[e][2] * pos[e][2];
+        noise[e] = FN(vselect)(f > 0,
+            f * f * f * f * DOT3(pos[e], grad[e]));
+    }
+    return (noise[0] + noise[1] + noise[2] + noise[3]) * 32.0f;
+}
+
+// Both batch kernels fill whole vectors only and return how many points
+// they did; the caller finishes the rest with the scalar functions
+static TARGET int FN(simplex2_batch)(
+    const float *x, const float *y, int n, float *out,
+    int octaves, float persistence, float lacunarity)
+{
+    int done = n - n % W;
+    for (int p = 0; p < done; p += W) {
+        VF vx, vy;
+        memcpy(&vx, x + p, sizeof(VF));
+        memcpy(&vy, y + p, sizeof(VF));
+        float freq = 1.0f;
+        float amp = 1.0f;
+        float max = 1.0f;
+        VF total = FN(noise2)(vx, vy);
+        for (int i = 1; i < octaves; i++) {
+            freq *= lacunarity;
+            amp *= persistence;
+            max += amp;
+            total += FN(noise2)(vx * freq, vy * freq) * amp;
+        }
+        VF result = (1 + total / max) / 2;
+        memcpy(out + p, &result, sizeof(VF));
+    }
+    return done;
+}
+
+static TARGET int FN(simplex3_batch)(
+    const float *x, const float *y, const float *z, int n, float *out,
+    int octaves, float persistence, float lacunarity)
+{
+    int done = n - n % W;
+    for (int p = 0; p < done; p += W) {
+        VF vx, vy, vz;
+        memcpy(&vx, x + p, sizeof(VF));
+        memcpy(&vy, y + p, sizeof(VF));
+        memcpy(&vz, z + p, sizeof(VF));
+        float freq = 1.0f;
+        float amp = 1.0f;
+        float max = 1.0f;
+        VF total = FN(noise3)(vx, vy, vz);
+        for (int i = 1; i < octaves; ++i) {
+            freq *= lacunarity;
+            amp *= persistence;
+            max += amp;
+            total += FN(noise3)(vx * freq, vy * freq, vz * freq) * amp;
+        }
+        VF result = (1 + total / max) / 2;
+        memcpy(out + p, &result, sizeof(VF));
+    }
+    return done;
+}
+
+// simplex2_above over whole vectors: octaves stop once every lane is
+// decided, lanes still undecided at the end compare like simplex2. Adds
+// the octaves summed per point to *summed.
+static TARGET int FN(simplex2_above_batch)(
+    const float *x, const float *y, int n, char *out, float limit,
+    float max, int octaves, float persistence, float lacunarity,
+    unsigned long *summed)
+{
+    int done = n - n % W;
+    float need = (2 * limit - 1) * max;
+    for (int p = 0; p < done; p += W) {
+        VF vx, vy;
+        memcpy(&vx, x + p, sizeof(VF));
+        memcpy(&vy, y + p, sizeof(VF));
+        float left = max - 1.0f;
+        float freq = 1.0f;
+        float amp = 1.0f;
+        VF total = FN(noise2)(vx, vy);
+        int i;
+        for (i = 1; i < octaves; i++) {
+            VI low = total + left * NOISE2_BOUND < need - NOISE_MARGIN;
+            VI high = total - left * NOISE2_BOUND > need + NOISE_MARGIN;
+            VI open = ~(low | high);
+            int undecided = 0;
+            for (int l = 0; l < W; l++) {
+                undecided |= open[l];
+            }
+            if (!undecided) {
+                break;
+            }
+            freq *= lacunarity;
+            amp *= persistence;
+            left -= amp;
+            total += FN(noise2)(vx * freq, vy * freq) * amp;
+        }
+        *summed += (unsigned long)i * W;
+        VI above = i < octaves ? total > need : (1 + total / max) / 2 > limit;
+        for (int l = 0; l < W; l++) {
+            out[p + l] = above[l] != 0;
+        }
+    }
+    return done;
+}
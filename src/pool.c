@@ -0,0 +1,243 @@
+#define _GNU_SOURCE // MAP_HUGETLB and madvise under -std=c99
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pool.h"
+#if POOL_HUGEPAGES && defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// Size classes step by a quarter octave from 256 bytes up to 16 MB, so a
+// block wastes at most a fifth of its size. Bigger requests go to malloc.
+#define POOL_MIN_SHIFT 8
+#define POOL_CLASSES 64
+#define POOL_LARGE -1
+
+// Blocks carry no header, so a power-of-two request fills its class
+// exactly. The class comes from the slab a block lies in, found by binary
+// search over the slabs sorted by address; a block in no slab came from
+// malloc. While a block is on a free list it links to the next free one.
+typedef struct Block {
+    struct Block *next;
+} Block;
+
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    int size_class;
+} Slab;
+
+static Block *free_lists[POOL_CLASSES];
+static Slab *slabs;
+static int slab_count;
+static int slab_capacity;
+static PoolStats stats;
+static volatile int pool_lock = 0;
+
+static void pool_acquire() {
+    while (__sync_lock_test_and_set(&pool_lock, 1)) {
+        while (pool_lock);
+    }
+}
+
+static void pool_release() {
+    __sync_lock_release(&pool_lock);
+}
+
+static size_t pool_class_size(int size_class) {
+    return (size_t)(4 + size_class % 4) <<
+        (size_class / 4 + POOL_MIN_SHIFT - 2);
+}
+
+// Smallest class holding size bytes, or POOL_LARGE
+static int pool_class(size_t size) {
+    if (size <= (size_t)1 << POOL_MIN_SHIFT) {
+        return 0;
+    }
+    int k = 63 - __builtin_clzll((unsigned long long)size - 1);
+    int v = (int)((size - 1) >> (k - 2));
+    int size_class = (k - POOL_MIN_SHIFT) * 4 + v - 3;
+    return size_class < POOL_CLASSES ? size_class : POOL_LARGE;
+}
+
+static void *pool_map(size_t size) {
+#if POOL_HUGEPAGES && defined(__linux__)
+    void *ptr = mmap(0, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) {
+        return ptr;
+    }
+    ptr = mmap(0, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return 0;
+    }
+    madvise(ptr, size, MADV_HUGEPAGE);
+    return ptr;
+#else
+    return malloc(size);
+#endif
+}
+
+// Class of the slab holding ptr, or POOL_LARGE. Call with the lock held.
+static int pool_find(void *ptr) {
+    uintptr_t address = (uintptr_t)ptr;
+    int lo = 0;
+    int hi = slab_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (address < slabs[mid].start) {
+            hi = mid;
+        }
+        else if (address >= slabs[mid].end) {
+            lo = mid + 1;
+        }
+        else {
+            return slabs[mid].size_class;
+        }
+    }
+    return POOL_LARGE;
+}
+
+// Files a new slab in address order. Slabs are rare, so the shift is cheap.
+static int pool_add_slab(char *slab, size_t slab_size, int size_class) {
+    if (slab_count == slab_capacity) {
+        int capacity = slab_capacity ? slab_capacity * 2 : 64;
+        Slab *grown = (Slab *)realloc(slabs, capacity * sizeof(Slab));
+        if (!grown) {
+            return 0;
+        }
+        slabs = grown;
+        slab_capacity = capacity;
+    }
+    uintptr_t start = (uintptr_t)slab;
+    int i = slab_count;
+    while (i > 0 && slabs[i - 1].start > start) {
+        slabs[i] = slabs[i - 1];
+        i--;
+    }
+    slabs[i].start = start;
+    slabs[i].end = start + slab_size;
+    slabs[i].size_class = size_class;
+    slab_count++;
+    return 1;
+}
+
+// Carves a fresh slab into blocks of one class. Slabs are never given
+// back; their blocks cycle through the free list instead.
+static int pool_refill(int size_class) {
+    size_t block_size = pool_class_size(size_class);
+    size_t slab_size = POOL_SLAB;
+    if (block_size > slab_size) {
+        slab_size = (block_size + POOL_SLAB - 1) / POOL_SLAB * POOL_SLAB;
+    }
+    char *slab = (char *)pool_map(slab_size);
+    if (!slab) {
+        return 0;
+    }
+    if (!pool_add_slab(slab, slab_size, size_class)) {
+        // without an entry its blocks couldn't be freed, so it stays unused
+        return 0;
+    }
+    stats.slabs++;
+    stats.slab_bytes += slab_size;
+    for (size_t offset = 0; offset + block_size <= slab_size;
+        offset += block_size)
+    {
+        Block *block = (Block *)(slab + offset);
+        block->next = free_lists[size_class];
+        free_lists[size_class] = block;
+    }
+    return 1;
+}
+
+void *pool_alloc(size_t size) {
+    int size_class = pool_class(size);
+    Block *block = 0;
+    pool_acquire();
+    if (size_class == POOL_LARGE) {
+        block = (Block *)malloc(size);
+        stats.misses++;
+    }
+    else {
+        if (free_lists[size_class]) {
+            stats.hits++;
+        }
+        else {
+            stats.misses++;
+            pool_refill(size_class);
+        }
+        block = free_lists[size_class];
+        if (block) {
+            free_lists[size_class] = block->next;
+        }
+    }
+    if (block) {
+        stats.in_use++;
+    }
+    pool_release();
+    return block;
+}
+
+void *pool_calloc(size_t count, size_t size) {
+    void *ptr = pool_alloc(count * size);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void *pool_realloc(void *ptr, size_t size) {
+    if (!ptr) {
+        return pool_alloc(size);
+    }
+    pool_acquire();
+    int size_class = pool_find(ptr);
+    pool_release();
+    int new_class = pool_class(size);
+    if (size_class == POOL_LARGE && new_class == POOL_LARGE) {
+        return realloc(ptr, size);
+    }
+    if (size_class == new_class) {
+        return ptr;
+    }
+    // a large block is always bigger than any pooled one, so only the
+    // new size needs copying when shrinking out of malloc
+    void *result = pool_alloc(size);
+    if (!result) {
+        return 0;
+    }
+    if (size_class == POOL_LARGE) {
+        memcpy(result, ptr, size);
+    }
+    else {
+        size_t old_size = pool_class_size(size_class);
+        memcpy(result, ptr, old_size < size ? old_size : size);
+    }
+    pool_free(ptr);
+    return result;
+}
+
+void pool_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    pool_acquire();
+    int size_class = pool_find(ptr);
+    stats.in_use--;
+    if (size_class == POOL_LARGE) {
+        pool_release();
+        free(ptr);
+        return;
+    }
+    Block *block = (Block *)ptr;
+    block->next = free_lists[size_class];
+    free_lists[size_class] = block;
+    pool_release();
+}
+
+void pool_stats(PoolStats *result) {
+    pool_acquire();
+    *result = stats;
+    pool_release();
+}
@@ -0,0 +1,28 @@
+#ifndef _pool_h_
+#define _pool_h_
+
+#include <stddef.h>
+
+// Build with -DPOOL_HUGEPAGES=1 to back slabs with 2 MB pages on Linux,
+// falling back to transparent hugepages when none are reserved
+#ifndef POOL_HUGEPAGES
+#define POOL_HUGEPAGES 0
+#endif
+
+#define POOL_SLAB (2 * 1024 * 1024)
+
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long slabs;
+    unsigned long slab_bytes;
+    unsigned long in_use;
+} PoolStats;
+
+void *pool_alloc(size_t size);
+void *pool_calloc(size_t count, size_t size);
+void *pool_realloc(void *ptr, size_t size);
+void pool_free(void *ptr);
+void pool_stats(PoolStats *stats);
+
+#endif
@@ -0,0 +1,225 @@
+#define _POSIX_C_SOURCE 199309L // clock_gettime and nanosleep under -std=c99
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cache.h"
+#include "map.h"
+#include "world.h"
+
+// Generates a region of chunks on every core ahead of time and stores them
+// in the chunk cache, so a client run from the same directory loads them
+// instead of generating them. The server never reads the cache. Chunks
+// use the default seed, the only one the client generates with. Doubles
+// as a generation throughput benchmark.
+
+#define MAX_THREADS 256
+
+// A generous size for one cached chunk, terrain and clouds; most come to
+// about 3.5 KB
+#define CHUNK_BYTES 4096
+
+typedef struct {
+    int p;
+    int q;
+} Job;
+
+static Job *jobs;
+static int job_count;
+static int next_job = 0;
+static volatile int done = 0;
+static int skipped = 0;
+static long blocks = 0;
+static int force = 0;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *worker(void *arg) {
+    (void)arg;
+    while (1) {
+        int index = __sync_fetch_and_add(&next_job, 1);
+        if (index >= job_count) {
+            break;
+        }
+        Job *job = jobs + index;
+        Map map;
+        unsigned char clouds[CLOUD_LAYER];
+        map_alloc_chunk(&map, job->p, job->q);
+        if (!force && cache_load(&map, clouds, job->p, job->q)) {
+            __sync_fetch_and_add(&skipped, 1);
+        }
+        else {
+            make_world(&map, job->p, job->q);
+            make_clouds(clouds, job->p, job->q);
+            cache_store(&map, clouds, job->p, job->q);
+            __sync_fetch_and_add(&blocks, map.size);
+        }
+        map_free(&map);
+        __sync_fetch_and_add(&done, 1);
+    }
+    return 0;
+}
+
+static int job_distance(const Job *job) {
+    return job->p * job->p + job->q * job->q;
+}
+
+// Nearest chunks first, so an interrupted run still covers the centre
+static int job_compare(const void *a, const void *b) {
+    return job_distance((const Job *)a) - job_distance((const Job *)b);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [options] radius P Q R\n"
+        "       %s [options] rect P0 Q0 P1 Q1\n"
+        "  -t threads   worker threads (default: all cores)\n"
+        "  -o path      cache directory (default " CACHE_PATH ")\n"
+        "  -l mb        cache size limit in MB, which the region must fit\n"
+        "  -f           regenerate chunks that are already cached\n",
+        name, name);
+}
+
+int main(int argc, char **argv) {
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *path = CACHE_PATH;
+    long limit = CACHE_LIMIT;
+    int arg = 1;
+    while (arg < argc && argv[arg][0] == '-') {
+        char option = argv[arg][1];
+        if (option == 'f') {
+            force = 1;
+            arg++;
+            continue;
+        }
+        if (arg + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        char *value = argv[arg + 1];
+        if (option == 't') {
+            threads = atoi(value);
+        }
+        else if (option == 'o') {
+            path = value;
+        }
+        else if (option == 'l') {
+            limit = atol(value) * 1024 * 1024;
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+        arg += 2;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+
+    int p0, q0, p1, q1, cp = 0, cq = 0, radius = -1;
+    if (argc - arg == 4 && !strcmp(argv[arg], "radius")) {
+        cp = atoi(argv[arg + 1]);
+        cq = atoi(argv[arg + 2]);
+        radius = atoi(argv[arg + 3]);
+        p0 = cp - radius; p1 = cp + radius;
+        q0 = cq - radius; q1 = cq + radius;
+    }
+    else if (argc - arg == 5 && !strcmp(argv[arg], "rect")) {
+        p0 = atoi(argv[arg + 1]);
+        q0 = atoi(argv[arg + 2]);
+        p1 = atoi(argv[arg + 3]);
+        q1 = atoi(argv[arg + 4]);
+        cp = (p0 + p1) / 2;
+        cq = (q0 + q1) / 2;
+    }
+    else {
+        usage(argv[0]);
+        return 1;
+    }
+    if (p1 < p0 || q1 < q0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    jobs = (Job *)malloc((long)(p1 - p0 + 1) * (q1 - q0 + 1) * sizeof(Job));
+    job_count = 0;
+    for (int p = p0; p <= p1; p++) {
+        for (int q = q0; q <= q1; q++) {
+            Job *job = jobs + job_count;
+            job->p = p - cp;
+            job->q = q - cq;
+            if (radius < 0 || job_distance(job) <= radius * radius) {
+                job_count++;
+            }
+        }
+    }
+    qsort(jobs, job_count, sizeof(Job), job_compare);
+    for (int i = 0; i < job_count; i++) {
+        jobs[i].p += cp;
+        jobs[i].q += cq;
+    }
+
+    // the cache evicts its oldest files first, which would be the centre
+    // this run stores first, so the whole region has to fit
+    long needed = (long)job_count * CHUNK_BYTES;
+    if (needed > limit) {
+        fprintf(stderr, "%d chunks need about %ld MB of cache, more than "
+            "the %ld MB limit; raise it with -l\n", job_count,
+            (needed + 1024 * 1024 - 1) / (1024 * 1024), limit / (1024 * 1024));
+        free(jobs);
+        return 1;
+    }
+    if (!cache_init(path, limit)) {
+        fprintf(stderr, "cannot open cache directory %s\n", path);
+        free(jobs);
+        return 1;
+    }
+    double start = now();
+    pthread_t workers[MAX_THREADS];
+    int started = 0;
+    while (started < threads &&
+        !pthread_create(workers + started, 0, worker, 0))
+    {
+        started++;
+    }
+    if (!started) {
+        fprintf(stderr, "cannot start worker threads\n");
+        cache_close();
+        free(jobs);
+        return 1;
+    }
+    threads = started;
+    printf("generating %d chunks on %d threads into %s\n",
+        job_count, threads, path);
+    while (done < job_count) {
+        struct timespec delay = {0, 250000000};
+        nanosleep(&delay, 0);
+        double elapsed = now() - start;
+        printf("\r%d/%d chunks, %.1f chunks/s", done, job_count,
+            elapsed > 0 ? done / elapsed : 0);
+        fflush(stdout);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], 0);
+    }
+    double elapsed = now() - start;
+    int generated = job_count - skipped;
+    printf("\n%d chunks generated, %d already cached, %.2f s\n",
+        generated, skipped, elapsed);
+    printf("%.1f chunks/s, %.3f ms/chunk per thread, %.0f blocks/chunk\n",
+        elapsed > 0 ? job_count / elapsed : 0,
+        job_count ? elapsed * 1000 * threads / job_count : 0,
+        generated ? (double)blocks / generated : 0);
+    cache_close();
+    free(jobs);
+    return 0;
+}
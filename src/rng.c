@@ -0,0 +1,26 @@
+#include "rng.h"
+
+static unsigned int rng_mix(unsigned int h) {
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+unsigned int rng_hash(unsigned int seed, int x, int y, int z, int stream) {
+    unsigned int h = rng_mix(seed ^ 0x9e3779b9u);
+    h = rng_mix(h ^ (unsigned int)x);
+    h = rng_mix(h ^ (unsigned int)y);
+    h = rng_mix(h ^ (unsigned int)z);
+    return rng_mix(h ^ (unsigned int)stream);
+}
+
+// Uniform in [min, max]
+int rng_range(
+    unsigned int seed, int x, int y, int z, int stream, int min, int max)
+{
+    unsigned long long n = (unsigned long long)(max - min) + 1;
+    return min + (int)((rng_hash(seed, x, y, z, stream) * n) >> 32);
+}
@@ -0,0 +1,11 @@
+#ifndef _rng_h_
+#define _rng_h_
+
+// Counter-based random numbers for world generation: the result depends
+// only on the seed, the coordinates and a stream id picking what it is
+// for, so any thread regenerating a chunk gets the same numbers.
+unsigned int rng_hash(unsigned int seed, int x, int y, int z, int stream);
+int rng_range(
+    unsigned int seed, int x, int y, int z, int stream, int min, int max);
+
+#endif
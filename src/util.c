@@ -263,10 +263,21 @@ void mat_ortho(
     matrix[15] = 1;
 }
 
+static void make_vertex(
+    Vertex *vertex, float x, float y, float z, int w, int face)
+{
+    vertex->x = roundf(x * VERTEX_SCALE);
+    vertex->y = roundf(y * VERTEX_SCALE);
+    vertex->z = roundf(z * VERTEX_SCALE);
+    vertex->data = w | face << 8;
+}
+
 void make_plant(
-    float *vertex, float *normal, float *texture,
-    float x, float y, float z, float n, int w, float rotation)
+    Vertex *data, float x, float y, float z, float n, int w, float rotation)
 {
+    float vertex[72];
+    float normal[72];
+    float texture[48];
     float *v = vertex;
     float *d = normal;
     float *t = texture;
@@ -370,149 +381,70 @@ void make_plant(
         d = normal + i * 3;
         *(d++) = vec[0]; *(d++) = vec[1]; *(d++) = vec[2];
     }
+    // the texture corner as two bits and the normal, which stays level,
+    // as one of VERTEX_ANGLES directions
+    for (int i = 0; i < 24; i++) {
+        v = vertex + i * 3;
+        d = normal + i * 3;
+        t = texture + i * 2;
+        int corner = (t[0] - du > s / 2) + (t[1] - dv > s / 2) * 2;
+        float angle = atan2f(d[2], d[0]);
+        int step = roundf(angle / (2 * PI) * VERTEX_ANGLES);
+        step = (step % VERTEX_ANGLES + VERTEX_ANGLES) % VERTEX_ANGLES;
+        make_vertex(data + i, v[0], v[1], v[2],
+            w + 1, VERTEX_PLANT + step * 4 + corner);
+    }
 }
 
+
 void make_cube(
-    float *vertex, float *normal, float *texture,
+    Vertex *vertex,
     int left, int right, int top, int bottom, int front, int back,
     float x, float y, float z, float n, int w)
 {
-    float *v = vertex;
-    float *d = normal;
-    float *t = texture;
-    float s = 0.0625;
-    float a = 0;
-    float b = s;
-    float du, dv;
-    float ou, ov;
-    w--;
-    ou = (w % 16) * s;
-    ov = (w / 16 * 3) * s;
-    if (left) {
-        du = ou; dv = ov + s;
-        *(v++) = x - n; *(v++) = y - n; *(v++) = z - n;
-        *(v++) = x - n; *(v++) = y + n; *(v++) = z + n;
-        *(v++) = x - n; *(v++) = y + n; *(v++) = z - n;
-        *(v++) = x - n; *(v++) = y - n; *(v++) = z - n;
-        *(v++) = x - n; *(v++) = y - n; *(v++) = z + n;
-        *(v++) = x - n; *(v++) = y + n; *(v++) = z + n;
-        *(d++) = -1; *(d++) = 0; *(d++) = 0;
-        *(d++) = -1; *(d++) = 0; *(d++) = 0;
-        *(d++) = -1; *(d++) = 0; *(d++) = 0;
-        *(d++) = -1; *(d++) = 0; *(d++) = 0;
-        *(d++) = -1; *(d++) = 0; *(d++) = 0;
-        *(d++) = -1; *(d++) = 0; *(d++) = 0;
-        *(t++) = a + du; *(t++) = a + dv;
-        *(t++) = b + du; *(t++) = b + dv;
-        *(t++) = a + du; *(t++) = b + dv;
-        *(t++) = a + du; *(t++) = a + dv;
-        *(t++) = b + du; *(t++) = a + dv;
-        *(t++) = b + du; *(t++) = b + dv;
-    }
-    if (right) {
-		du = ou; dv = ov + s;
-        *(v++) = x + n; *(v++) = y - n; *(v++) = z - n;
-        *(v++) = x + n; *(v++) = y + n; *(v++) = z + n;
-        *(v++) = x + n; *(v++) = y - n; *(v++) = z + n;
-        *(v++) = x + n; *(v++) = y - n; *(v++) = z - n;
-        *(v++) = x + n; *(v++) = y + n; *(v++) = z - n;
-        *(v++) = x + n; *(v++) = y + n; *(v++) = z + n;
-        *(d++) = 1; *(d++) = 0; *(d++) = 0;
-        *(d++) = 1; *(d++) = 0; *(d++) = 0;
-        *(d++) = 1; *(d++) = 0; *(d++) = 0;
-        *(d++) = 1; *(d++) = 0; *(d++) = 0;
-        *(d++) = 1; *(d++) = 0; *(d++) = 0;
-        *(d++) = 1; *(d++) = 0; *(d++) = 0;
-        *(t++) = b + du; *(t++) = a + dv;
-        *(t++) = a + du; *(t++) = b + dv;
-        *(t++) = a + du; *(t++) = a + dv;
-        *(t++) = b + du; *(t++) = a + dv;
-        *(t++) = b + du; *(t++) = b + dv;
-        *(t++) = a + du; *(t++) = b + dv;
-    }
-    if (top) {
-		du = ou; dv = ov + s + s;
-        *(v++) = x - n; *(v++) = y + n; *(v++) = z - n;
-        *(v++) = x - n; *(v++) = y + n; *(v++) = z + n;
-        *(v++) = x + n; *(v++) = y + n; *(v++) = z + n;
-        *(v++) = x - n; *(v++) = y + n; *(v++) = z - n;
-        *(v++) = x + n; *(v++) = y + n; *(v++) = z + n;
-        *(v++) = x + n; *(v++) = y + n; *(v++) = z - n;
-        *(d++) = 0; *(d++) = 1; *(d++) = 0;
-        *(d++) = 0; *(d++) = 1; *(d++) = 0;
-        *(d++) = 0; *(d++) = 1; *(d++) = 0;
-        *(d++) = 0; *(d++) = 1; *(d++) = 0;
-        *(d++) = 0; *(d++) = 1; *(d++) = 0;
-        *(d++) = 0; *(d++) = 1; *(d++) = 0;
-        *(t++) = a + du; *(t++) = b + dv;
-        *(t++) = a + du; *(t++) = a + dv;
-        *(t++) = b + du; *(t++) = a + dv;
-        *(t++) = a + du; *(t++) = b + dv;
-        *(t++) = b + du; *(t++) = a + dv;
-        *(t++) = b + du; *(t++) = b + dv;
-    }
-    if (bottom) {
-        du = ou; dv = ov + 0;
-        *(v++) = x - n; *(v++) = y - n; *(v++) = z - n;
-        *(v++) = x + n; *(v++) = y - n; *(v++) = z - n;
-        *(v++) = x + n; *(v++) = y - n; *(v++) = z + n;
-        *(v++) = x - n; *(v++) = y - n; *(v++) = z - n;
-        *(v++) = x + n; *(v++) = y - n; *(v++) = z + n;
-        *(v++) = x - n; *(v++) = y - n; *(v++) = z + n;
-        *(d++) = 0; *(d++) = -1; *(d++) = 0;
-        *(d++) = 0; *(d++) = -1; *(d++) = 0;
-        *(d++) = 0; *(d++) = -1; *(d++) = 0;
-        *(d++) = 0; *(d++) = -1; *(d++) = 0;
-        *(d++) = 0; *(d++) = -1; *(d++) = 0;
-        *(d++) = 0; *(d++) = -1; *(d++) = 0;
-        *(t++) = a + du; *(t++) = a + dv;
-        *(t++) = b + du; *(t++) = a + dv;
-        *(t++) = b + du; *(t++) = b + dv;
-        *(t++) = a + du; *(t++) = a + dv;
-        *(t++) = b + du; *(t++) = b + dv;
-        *(t++) = a + du; *(t++) = b + dv;
-    }
-    if (front) {
-        du = ou; dv = ov + s;
-        *(v++) = x - n; *(v++) = y - n; *(v++) = z + n;
-        *(v++) = x + n; *(v++) = y - n; *(v++) = z + n;
-        *(v++) = x + n; *(v++) = y + n; *(v++) = z + n;
-        *(v++) = x - n; *(v++) = y - n; *(v++) = z + n;
-        *(v++) = x + n; *(v++) = y + n; *(v++) = z + n;
-        *(v++) = x - n; *(v++) = y + n; *(v++) = z + n;
-        *(d++) = 0; *(d++) = 0; *(d++) = -1;
-        *(d++) = 0; *(d++) = 0; *(d++) = -1;
-        *(d++) = 0; *(d++) = 0; *(d++) = -1;
-        *(d++) = 0; *(d++) = 0; *(d++) = -1;
-        *(d++) = 0; *(d++) = 0; *(d++) = -1;
-        *(d++) = 0; *(d++) = 0; *(d++) = -1;
-        *(t++) = b + du; *(t++) = a + dv;
-        *(t++) = a + du; *(t++) = a + dv;
-        *(t++) = a + du; *(t++) = b + dv;
-        *(t++) = b + du; *(t++) = a + dv;
-        *(t++) = a + du; *(t++) = b + dv;
-        *(t++) = b + du; *(t++) = b + dv;
+    int faces[6] = {left, right, top, bottom, front, back};
+    for (int i = 0; i < 6; i++) {
+        if (faces[i]) {
+            make_quad(vertex, i, x, y, z, n, 1, 1, w);
+            vertex += 6;
+        }
     }
-    if (back) {
-        du = ou; dv = ov + s;
-        *(v++) = x - n; *(v++) = y - n; *(v++) = z - n;
-        *(v++) = x + n; *(v++) = y + n; *(v++) = z - n;
-        *(v++) = x + n; *(v++) = y - n; *(v++) = z - n;
-        *(v++) = x - n; *(v++) = y - n; *(v++) = z - n;
-        *(v++) = x - n; *(v++) = y + n; *(v++) = z - n;
-        *(v++) = x + n; *(v++) = y + n; *(v++) = z - n;
-        *(d++) = 0; *(d++) = 0; *(d++) = 1;
-        *(d++) = 0; *(d++) = 0; *(d++) = 1;
-        *(d++) = 0; *(d++) = 0; *(d++) = 1;
-        *(d++) = 0; *(d++) = 0; *(d++) = 1;
-        *(d++) = 0; *(d++) = 0; *(d++) = 1;
-        *(d++) = 0; *(d++) = 0; *(d++) = 1;
-        *(t++) = a + du; *(t++) = a + dv;
-        *(t++) = b + du; *(t++) = b + dv;
-        *(t++) = b + du; *(t++) = a + dv;
-        *(t++) = a + du; *(t++) = a + dv;
-        *(t++) = a + du; *(t++) = b + dv;
-        *(t++) = b + du; *(t++) = b + dv;
+}
+
+// Corners of each cube face as (u, v) steps in the order the face is
+// drawn, where u runs along z for left/right and along x otherwise, and v
+// along z for top/bottom and along y otherwise
+static const int quad_corners[6][6][2] = {
+    {{0, 0}, {1, 1}, {0, 1}, {0, 0}, {1, 0}, {1, 1}},
+    {{0, 0}, {1, 1}, {1, 0}, {0, 0}, {0, 1}, {1, 1}},
+    {{0, 0}, {0, 1}, {1, 1}, {0, 0}, {1, 1}, {1, 0}},
+    {{0, 0}, {1, 0}, {1, 1}, {0, 0}, {1, 1}, {0, 1}},
+    {{0, 0}, {1, 0}, {1, 1}, {0, 0}, {1, 1}, {0, 1}},
+    {{0, 0}, {1, 1}, {1, 0}, {0, 0}, {0, 1}, {1, 1}}
+};
+
+// One face of a width x height rectangle of blocks, (x, y, z) being the
+// block with the lowest coordinates. Its normal and texture follow from
+// the face index in the vertex shader, which tiles the texture once per
+// block.
+void make_quad(
+    Vertex *vertex, int face, float x, float y, float z, float n,
+    int width, int height, int w)
+{
+    for (int i = 0; i < 6; i++) {
+        float u = quad_corners[face][i][0] * width * n * 2 - n;
+        float v = quad_corners[face][i][1] * height * n * 2 - n;
+        if (face < 2) {
+            make_vertex(vertex++, face ? x + n : x - n, y + v, z + u, w, face);
+        }
+        else if (face < 4) {
+            make_vertex(vertex++, x + u, face == 2 ? y + n : y - n, z + v,
+                w, face);
+        }
+        else {
+            make_vertex(vertex++, x + u, y + v, face == 4 ? z + n : z - n,
+                w, face);
+        }
     }
 }
 
@@ -23,6 +23,24 @@ typedef struct {
     double since;
 } FPS;
 
+// Chunk mesh vertex, 8 bytes: the position in 1/VERTEX_SCALE blocks from
+// the chunk origin, which sits VERTEX_ORIGIN blocks below and behind the
+// chunk's first block so rotated plants on its border stay positive, and
+// in data the block type with the face above it. Cube faces are 0-5 in
+// make_cube's order. Plant faces store VERTEX_PLANT + 4 * normal direction
+// + texture corner, the normal being one of VERTEX_ANGLES level directions.
+typedef struct {
+    GLushort x;
+    GLushort y;
+    GLushort z;
+    GLushort data;
+} Vertex;
+
+#define VERTEX_SCALE 256
+#define VERTEX_ORIGIN 1
+#define VERTEX_PLANT 64
+#define VERTEX_ANGLES 48
+
 int rand_int(int n);
 double rand_double();
 int random_number(int min_num, int max_num);
@@ -56,12 +74,14 @@ void mat_ortho(
     float *matrix,
     float left, float right, float bottom, float top, float near, float far);
 void make_plant(
-    float *vertex, float *normal, float *texture,
-    float x, float y, float z, float n, int w, float rotation);
+    Vertex *data, float x, float y, float z, float n, int w, float rotation);
 void make_cube(
-    float *vertex, float *normal, float *texture,
+    Vertex *vertex,
     int left, int right, int top, int bottom, int front, int back,
     float x, float y, float z, float n, int w);
+void make_quad(
+    Vertex *vertex, int face, float x, float y, float z, float n,
+    int width, int height, int w);
 void make_character(
 	float *vertex, float *texture,
 	float x, float y, float n, float m, char c);
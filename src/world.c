@@ -0,0 +1,646 @@
+#include <stdlib.h>
+#include <string.h>
+#include "world.h"
+#include "noise.h"
+#include "rng.h"
+
+// Streams of the generation RNG, one per use
+#define RNG_TALL_GRASS 1
+
+// Trees can root up to TREE_RADIUS columns outside the chunk and still
+// reach into it, so their fields cover a wider ROOT_SPAN square
+#define TREE_RADIUS 3
+#define ROOT_SPAN (MAP_SPAN + TREE_RADIUS * 2)
+#define ROOT_LAYER (ROOT_SPAN * ROOT_SPAN)
+
+// Density lattice points, one past the tree roots on every side, each
+// holding its DENSITY_LEVELS values next to each other
+#define DENSITY_PAD ((TREE_RADIUS + DENSITY_XZ - 1) / DENSITY_XZ)
+#define DENSITY_SPAN (MAP_SPAN / DENSITY_XZ + 1 + DENSITY_PAD * 2)
+#define DENSITY_LEVELS (CHUNK_HEIGHT / DENSITY_Y + 1)
+#define DENSITY_POINTS (DENSITY_SPAN * DENSITY_SPAN * DENSITY_LEVELS)
+
+// Noise fields a chunk is generated from, one value per chunk column
+// (z * MAP_SPAN + x). Height and amplitude cover every column; the rest
+// only the columns placement actually reads, and only as the yes/no answer
+// of their threshold test. Tree fields are per ROOT_SPAN column and clouds
+// per CLOUD_SPAN column instead.
+typedef struct {
+    int p;
+    int q;
+    unsigned int used;
+    float height[MAP_LAYER];
+    float amplitude[MAP_LAYER];
+    char tree[ROOT_LAYER];
+    int root_height[ROOT_LAYER];
+    char plant[MAP_LAYER];
+    char grass[MAP_LAYER];
+    char tall_grass[MAP_LAYER];
+    float cloud[CLOUD_LAYER * CLOUD_LAYERS];
+#if WORLD_DENSITY
+    float density[DENSITY_POINTS];
+#endif
+} Fields;
+
+// Fields of recently generated chunks, kept per thread. A chunk made again
+// reuses its own; a new chunk copies the cloud ring it shares with any
+// cached neighbour instead of evaluating it again.
+#define FIELD_CACHE 32
+static __thread Fields *field_cache[FIELD_CACHE];
+static __thread unsigned int field_clock;
+
+static unsigned int world_seed = 0;
+
+void set_world_seed(unsigned int seed) {
+    world_seed = seed;
+}
+
+unsigned int get_world_seed() {
+    return world_seed;
+}
+
+// Build options that change the output count as a different generator.
+// The lattice tolerance is a float, so its bits are hashed into the top
+// half; it only matters when the lattice is on.
+unsigned int get_world_version() {
+    unsigned int version =
+        WORLD_VERSION << 8 | WORLD_DENSITY << 7 | WORLD_LATTICE;
+    if (WORLD_LATTICE) {
+        float error = WORLD_LATTICE_ERROR;
+        unsigned int bits;
+        memcpy(&bits, &error, sizeof(bits));
+        version |= (bits * 2654435761u) >> 16 << 16;
+    }
+    return version;
+}
+
+static int column_height(float f, float g, int *w) {
+    int mh = g * 32 + 16;
+    int h = f * mh;
+    int t = 12;
+    *w = 1;
+    if (h <= t) {
+        h = t;
+        *w = 2;
+    }
+    return h;
+}
+
+// Noise coordinates of the given columns of a span x span square that
+// extends pad blocks past the chunk on every side
+static void field_points(
+    float *xs, float *zs, const int *columns, int count, int span, int pad,
+    int p, int q, double sx, double sz)
+{
+    for (int i = 0; i < count; i++) {
+        int x = p * CHUNK_SIZE + columns[i] % span - pad;
+        int z = q * CHUNK_SIZE + columns[i] / span - pad;
+        xs[i] = x * sx;
+        zs[i] = z * sz;
+    }
+}
+
+static void field2(
+    float *field, const int *columns, int count, int span, int pad,
+    int p, int q, double sx, double sz,
+    int octaves, float persistence, float lacunarity)
+{
+    float xs[ROOT_LAYER];
+    float zs[ROOT_LAYER];
+    float values[ROOT_LAYER];
+    field_points(xs, zs, columns, count, span, pad, p, q, sx, sz);
+    simplex2_batch(xs, zs, count, values, octaves, persistence, lacunarity);
+    for (int i = 0; i < count; i++) {
+        field[columns[i]] = values[i];
+    }
+}
+
+// Like field2 for placement tests: stores whether the field is above
+// threshold, which mostly takes far fewer octaves than the value itself
+static void field2_above(
+    char *field, const int *columns, int count, int span, int pad,
+    int p, int q, double sx, double sz, double threshold,
+    int octaves, float persistence, float lacunarity)
+{
+    float xs[ROOT_LAYER];
+    float zs[ROOT_LAYER];
+    char values[ROOT_LAYER];
+    field_points(xs, zs, columns, count, span, pad, p, q, sx, sz);
+    simplex2_above_batch(xs, zs, count, values, threshold,
+        octaves, persistence, lacunarity);
+    for (int i = 0; i < count; i++) {
+        field[columns[i]] = values[i];
+    }
+}
+
+#if WORLD_LATTICE || WORLD_DENSITY
+
+static int floor_div(int a, int b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+#endif
+
+#if WORLD_LATTICE
+
+// Lattice points along one side of a footprint, at most
+#define LATTICE_SPAN ((ROOT_SPAN - 1) / WORLD_LATTICE + 3)
+
+// Like field2 for slow fields: exact samples every WORLD_LATTICE blocks,
+// interpolated bilinearly in between. A lattice cell whose centre differs
+// from the interpolation by more than WORLD_LATTICE_ERROR is evaluated
+// exactly instead. The lattice is fixed in world space, so neighbouring
+// chunks agree on every shared column.
+static void lattice_field(
+    float *field, const int *columns, int count, int span, int pad,
+    int p, int q, double sx, double sz,
+    int octaves, float persistence, float lacunarity)
+{
+    int s = WORLD_LATTICE;
+    int x0 = p * CHUNK_SIZE - pad;
+    int z0 = q * CHUNK_SIZE - pad;
+    int lx0 = floor_div(x0, s);
+    int lz0 = floor_div(z0, s);
+    int nx = floor_div(x0 + span - 1, s) - lx0 + 2;
+    int nz = floor_div(z0 + span - 1, s) - lz0 + 2;
+    float xs[LATTICE_SPAN * LATTICE_SPAN * 2];
+    float zs[LATTICE_SPAN * LATTICE_SPAN * 2];
+    float values[LATTICE_SPAN * LATTICE_SPAN * 2];
+    int n = 0;
+    for (int j = 0; j < nz; j++) {
+        for (int i = 0; i < nx; i++) {
+            xs[n] = (lx0 + i) * s * sx;
+            zs[n] = (lz0 + j) * s * sz;
+            n++;
+        }
+    }
+    for (int j = 0; j + 1 < nz; j++) {
+        for (int i = 0; i + 1 < nx; i++) {
+            xs[n] = ((lx0 + i) * s + s / 2) * sx;
+            zs[n] = ((lz0 + j) * s + s / 2) * sz;
+            n++;
+        }
+    }
+    simplex2_batch(xs, zs, n, values, octaves, persistence, lacunarity);
+    float *corners = values;
+    float *centres = values + nx * nz;
+
+    int exact[ROOT_LAYER];
+    int exacts = 0;
+    for (int k = 0; k < count; k++) {
+        int x = x0 + columns[k] % span;
+        int z = z0 + columns[k] / span;
+        int i = floor_div(x, s) - lx0;
+        int j = floor_div(z, s) - lz0;
+        float a = corners[j * nx + i];
+        float b = corners[j * nx + i + 1];
+        float c = corners[(j + 1) * nx + i];
+        float d = corners[(j + 1) * nx + i + 1];
+        float error = centres[j * (nx - 1) + i] - (a + b + c + d) / 4;
+        if (error > WORLD_LATTICE_ERROR || error < -WORLD_LATTICE_ERROR) {
+            exact[exacts++] = columns[k];
+            continue;
+        }
+        float u = (float)(x - (lx0 + i) * s) / s;
+        float v = (float)(z - (lz0 + j) * s) / s;
+        field[columns[k]] =
+            (a + (b - a) * u) + ((c + (d - c) * u) - (a + (b - a) * u)) * v;
+    }
+    field2(field, exact, exacts, span, pad, p, q, sx, sz,
+        octaves, persistence, lacunarity);
+}
+
+#else
+
+#define lattice_field field2
+
+#endif
+
+static void cloud_field(
+    float *field, const int *columns, int count, int p, int q)
+{
+    int span = CLOUD_SPAN;
+    float xs[CLOUD_LAYERS * 64];
+    float ys[CLOUD_LAYERS * 64];
+    float zs[CLOUD_LAYERS * 64];
+    float values[CLOUD_LAYERS * 64];
+    for (int start = 0; start < count; start += 64) {
+        int n = count - start < 64 ? count - start : 64;
+        for (int i = 0; i < n; i++) {
+            int x = p * CHUNK_SIZE + columns[start + i] % span - CLOUD_PAD;
+            int z = q * CHUNK_SIZE + columns[start + i] / span - CLOUD_PAD;
+            for (int j = 0; j < CLOUD_LAYERS; j++) {
+                xs[i * CLOUD_LAYERS + j] = x * 0.014;
+                ys[i * CLOUD_LAYERS + j] = (CLOUD_BOTTOM + j) * 0.1;
+                zs[i * CLOUD_LAYERS + j] = z * 0.014;
+            }
+        }
+        simplex3_batch(xs, ys, zs, n * CLOUD_LAYERS, values, 6, 0.5, 2);
+        for (int i = 0; i < n; i++) {
+            memcpy(field + columns[start + i] * CLOUD_LAYERS,
+                values + i * CLOUD_LAYERS, CLOUD_LAYERS * sizeof(float));
+        }
+    }
+}
+
+#if WORLD_DENSITY
+
+// 3D noise on the coarse density lattice, in -1..1
+static void density_field(Fields *fields, int p, int q) {
+    float xs[DENSITY_POINTS];
+    float ys[DENSITY_POINTS];
+    float zs[DENSITY_POINTS];
+    int n = 0;
+    for (int gz = 0; gz < DENSITY_SPAN; gz++) {
+        for (int gx = 0; gx < DENSITY_SPAN; gx++) {
+            int x = p * CHUNK_SIZE + (gx - DENSITY_PAD) * DENSITY_XZ;
+            int z = q * CHUNK_SIZE + (gz - DENSITY_PAD) * DENSITY_XZ;
+            for (int level = 0; level < DENSITY_LEVELS; level++) {
+                xs[n] = x * 0.02;
+                ys[n] = level * DENSITY_Y * 0.04;
+                zs[n] = z * 0.02;
+                n++;
+            }
+        }
+    }
+    simplex3_batch(xs, ys, zs, n, fields->density, 3, 0.5, 2);
+    for (int i = 0; i < n; i++) {
+        fields->density[i] = fields->density[i] * 2 - 1;
+    }
+}
+
+// Density noise for column (chunk-local x, z) at one level, bilinear
+// between the four surrounding lattice columns
+static float density_level(Fields *fields, int x, int z, int level) {
+    int gx = floor_div(x, DENSITY_XZ);
+    int gz = floor_div(z, DENSITY_XZ);
+    float u = (float)(x - gx * DENSITY_XZ) / DENSITY_XZ;
+    float v = (float)(z - gz * DENSITY_XZ) / DENSITY_XZ;
+    gx += DENSITY_PAD;
+    gz += DENSITY_PAD;
+    float *a = fields->density + (gz * DENSITY_SPAN + gx) * DENSITY_LEVELS;
+    float *b = a + DENSITY_LEVELS;
+    float *c = a + DENSITY_SPAN * DENSITY_LEVELS;
+    float *d = c + DENSITY_LEVELS;
+    float ab = a[level] + (b[level] - a[level]) * u;
+    float cd = c[level] + (d[level] - c[level]) * u;
+    return ab + (cd - ab) * v;
+}
+
+// Whether block y of a column whose 2D height is h is solid, given the
+// column's noise at the levels below and above it. Noise is linear
+// between levels and the bottom block is always solid.
+static int density_solid(float lower, float upper, int y, int h) {
+    float t = (float)(y % DENSITY_Y) / DENSITY_Y;
+    float noise = lower + (upper - lower) * t;
+    return !y || h - y + noise * DENSITY_AMPLITUDE > 0;
+}
+
+// Nothing can be solid past h + DENSITY_AMPLITUDE
+static int density_top(int h) {
+    int top = h + DENSITY_AMPLITUDE;
+    return top < CHUNK_HEIGHT ? top : CHUNK_HEIGHT;
+}
+
+// Surface of one column (chunk-local x, z) whose 2D height is h: one above
+// the highest solid block. This is how tree roots outside the chunk agree
+// with the chunk that owns them.
+static int density_column(Fields *fields, int x, int z, int h) {
+    int top = density_top(h);
+    int surface = 1;
+    float lower = 0, upper = density_level(fields, x, z, 0);
+    for (int y = 0; y < top; y++) {
+        if (y % DENSITY_Y == 0) {
+            lower = upper;
+            upper = density_level(fields, x, z, y / DENSITY_Y + 1);
+        }
+        if (density_solid(lower, upper, y, h)) {
+            surface = y + 1;
+        }
+    }
+    return surface;
+}
+
+// Fills the chunk's terrain one layer at a time, z then x within each, the
+// order the dense map stores blocks in, and sets each column's surface.
+// Only the two levels around the current layer are kept per column, and a
+// column past its top never needs them again.
+static void density_fill(Map *map, Fields *fields, int *surfaces) {
+    int heights[MAP_LAYER];
+    char types[MAP_LAYER];
+    float lower[MAP_LAYER];
+    float upper[MAP_LAYER];
+    int top = 0;
+    for (int i = 0; i < MAP_LAYER; i++) {
+        int w;
+        heights[i] = column_height(
+            fields->height[i], fields->amplitude[i], &w);
+        types[i] = w;
+        surfaces[i] = 1;
+        upper[i] = density_level(fields, i % MAP_SPAN, i / MAP_SPAN, 0);
+        int column_top = density_top(heights[i]);
+        top = column_top > top ? column_top : top;
+    }
+    for (int y = 0; y < top; y++) {
+        if (y % DENSITY_Y == 0) {
+            int level = y / DENSITY_Y + 1;
+            for (int i = 0; i < MAP_LAYER; i++) {
+                if (y < density_top(heights[i])) {
+                    lower[i] = upper[i];
+                    upper[i] = density_level(
+                        fields, i % MAP_SPAN, i / MAP_SPAN, level);
+                }
+            }
+        }
+        for (int dz = 0; dz < CHUNK_SIZE; dz++) {
+            for (int dx = 0; dx < CHUNK_SIZE; dx++) {
+                int i = dz * MAP_SPAN + dx;
+                if (y >= density_top(heights[i]) ||
+                    !density_solid(lower[i], upper[i], y, heights[i]))
+                {
+                    continue;
+                }
+                map_set(map, map->dx + dx, y, map->dz + dz, types[i]);
+                surfaces[i] = y + 1;
+            }
+        }
+    }
+}
+
+#endif
+
+// Copies the cloud columns other shares with fields
+static void share_fields(Fields *fields, Fields *other, char *have) {
+    int a = (other->p - fields->p) * CHUNK_SIZE;
+    int b = (other->q - fields->q) * CHUNK_SIZE;
+    for (int z = b > 0 ? b : 0; z < CLOUD_SPAN && z - b < CLOUD_SPAN; z++) {
+        for (int x = a > 0 ? a : 0; x < CLOUD_SPAN && x - a < CLOUD_SPAN;
+            x++)
+        {
+            int i = z * CLOUD_SPAN + x;
+            int j = (z - b) * CLOUD_SPAN + (x - a);
+            memcpy(fields->cloud + i * CLOUD_LAYERS,
+                other->cloud + j * CLOUD_LAYERS,
+                CLOUD_LAYERS * sizeof(float));
+            have[i] = 1;
+        }
+    }
+}
+
+static Fields *make_fields(int p, int q) {
+    Fields *fields = 0;
+    int victim = 0;
+    field_clock++;
+    for (int i = 0; i < FIELD_CACHE; i++) {
+        Fields *entry = field_cache[i];
+        if (entry && entry->p == p && entry->q == q) {
+            entry->used = field_clock;
+            return entry;
+        }
+        if (!entry) {
+            victim = i;
+        }
+        else if (field_cache[victim] &&
+            entry->used < field_cache[victim]->used)
+        {
+            victim = i;
+        }
+    }
+    if (!field_cache[victim]) {
+        field_cache[victim] = (Fields *)malloc(sizeof(Fields));
+    }
+    fields = field_cache[victim];
+    fields->p = p;
+    fields->q = q;
+    fields->used = field_clock;
+
+    char have[CLOUD_LAYER] = {0};
+    for (int i = 0; i < FIELD_CACHE; i++) {
+        Fields *other = field_cache[i];
+        if (other && other != fields &&
+            abs(other->p - p) <= 1 && abs(other->q - q) <= 1)
+        {
+            share_fields(fields, other, have);
+        }
+    }
+
+    int columns[ROOT_LAYER];
+    int count = 0;
+    for (int i = 0; i < CLOUD_LAYER; i++) {
+        if (!have[i]) {
+            columns[count++] = i;
+        }
+    }
+    cloud_field(fields->cloud, columns, count, p, q);
+
+    for (int i = 0; i < MAP_LAYER; i++) {
+        columns[i] = i;
+    }
+    lattice_field(fields->height, columns, MAP_LAYER, MAP_SPAN, 0,
+        p, q, 0.01, 0.01, 4, 0.5, 2);
+    lattice_field(fields->amplitude, columns, MAP_LAYER, MAP_SPAN, 0,
+        p, q, -0.01, -0.01, 2, 0.9, 2);
+
+    // tree roots: every column within reach of the chunk, with heights for
+    // those outside it evaluated the same way as inside
+    float root_f[ROOT_LAYER];
+    float root_g[ROOT_LAYER];
+    count = 0;
+    for (int i = 0; i < ROOT_LAYER; i++) {
+        int x = i % ROOT_SPAN - TREE_RADIUS;
+        int z = i / ROOT_SPAN - TREE_RADIUS;
+        if (x < 0 || z < 0 || x >= MAP_SPAN || z >= MAP_SPAN) {
+            columns[count++] = i;
+        }
+        else {
+            root_f[i] = fields->height[z * MAP_SPAN + x];
+            root_g[i] = fields->amplitude[z * MAP_SPAN + x];
+        }
+    }
+    lattice_field(root_f, columns, count, ROOT_SPAN, TREE_RADIUS,
+        p, q, 0.01, 0.01, 4, 0.5, 2);
+    lattice_field(root_g, columns, count, ROOT_SPAN, TREE_RADIUS,
+        p, q, -0.01, -0.01, 2, 0.9, 2);
+    for (int i = 0; i < ROOT_LAYER; i++) {
+        columns[i] = i;
+    }
+    field2_above(fields->tree, columns, ROOT_LAYER, ROOT_SPAN, TREE_RADIUS,
+        p, q, 1, 1, 0.84, 6, 0.5, 2);
+#if WORLD_DENSITY
+    density_field(fields, p, q);
+#endif
+    for (int i = 0; i < ROOT_LAYER; i++) {
+        int w;
+        int h = column_height(root_f[i], root_g[i], &w);
+#if WORLD_DENSITY
+        // only trees need the surface, and few columns grow one
+        if (fields->tree[i]) {
+            h = density_column(fields, i % ROOT_SPAN - TREE_RADIUS,
+                i / ROOT_SPAN - TREE_RADIUS, h);
+        }
+#endif
+        fields->root_height[i] = h;
+    }
+
+    // plants and grass only grow on grass blocks
+    count = 0;
+    for (int i = 0; i < MAP_LAYER; i++) {
+        int w;
+        column_height(fields->height[i], fields->amplitude[i], &w);
+        if (w == 1) {
+            columns[count++] = i;
+        }
+    }
+    field2_above(fields->plant, columns, count, MAP_SPAN, 0,
+        p, q, 0.1, 0.15, 0.76, 4, 0.5, 2);
+    field2_above(fields->grass, columns, count, MAP_SPAN, 0,
+        p, q, 0.2, 0.3, 0.68, 4, 0.5, 2);
+    field2_above(fields->tall_grass, columns, count, MAP_SPAN, 0,
+        p, q, 0.014, 0.025, 0.78, 6, 0.5, 2);
+    return fields;
+}
+
+// Structure shapes as block offsets from their root, built once per thread
+// and stamped into chunks without recomputing the shape per instance
+#define TEMPLATE_BLOCKS 256
+
+typedef struct {
+    int count;
+    int w;
+    signed char x[TEMPLATE_BLOCKS];
+    signed char y[TEMPLATE_BLOCKS];
+    signed char z[TEMPLATE_BLOCKS];
+} Template;
+
+static __thread Template *tree_leaves;
+static __thread Template *tree_trunk;
+
+static void add_block(Template *shape, int x, int y, int z) {
+    shape->x[shape->count] = x;
+    shape->y[shape->count] = y;
+    shape->z[shape->count] = z;
+    shape->count++;
+}
+
+static void make_templates() {
+    tree_leaves = (Template *)calloc(1, sizeof(Template));
+    tree_leaves->w = 7;
+    for (int y = 3; y < 8; y++) {
+        for (int ox = -TREE_RADIUS; ox <= TREE_RADIUS; ox++) {
+            for (int oz = -TREE_RADIUS; oz <= TREE_RADIUS; oz++) {
+                int d = (ox * ox) + (oz * oz) + (y - 4) * (y - 4);
+                if (d < 11) {
+                    add_block(tree_leaves, ox, y, oz);
+                }
+            }
+        }
+    }
+    tree_trunk = (Template *)calloc(1, sizeof(Template));
+    tree_trunk->w = 5;
+    for (int y = 0; y < 7; y++) {
+        add_block(tree_trunk, 0, y, 0);
+    }
+}
+
+// Stamps shape at every tree root, clipped to the chunk. With soft set a
+// block only fills air above the terrain of its column, so the result does
+// not depend on which tree is stamped first.
+static void stamp_trees(
+    Map *map, Fields *fields, const int *heights, Template *shape,
+    int soft, int p, int q)
+{
+    for (int r = 0; r < ROOT_LAYER; r++) {
+        if (!fields->tree[r]) {
+            continue;
+        }
+        int rx = r % ROOT_SPAN - TREE_RADIUS;
+        int rz = r / ROOT_SPAN - TREE_RADIUS;
+        int h = fields->root_height[r];
+        for (int k = 0; k < shape->count; k++) {
+            int dx = rx + shape->x[k];
+            int dz = rz + shape->z[k];
+            if (dx < 0 || dz < 0 || dx >= CHUNK_SIZE || dz >= CHUNK_SIZE) {
+                continue;
+            }
+            int y = h + shape->y[k];
+            if (soft && y < heights[dz * MAP_SPAN + dx]) {
+                continue;
+            }
+            map_set(map, p * CHUNK_SIZE + dx, y, q * CHUNK_SIZE + dz,
+                shape->w);
+        }
+    }
+}
+
+// Generate map on spawn - Generate chunks
+void make_world(Map *map, int p, int q) {
+    Fields *fields = make_fields(p, q);
+    if (!tree_leaves) {
+        make_templates();
+    }
+    int heights[MAP_LAYER];
+#if WORLD_DENSITY
+    density_fill(map, fields, heights);
+#endif
+    for (int dx = 0; dx < CHUNK_SIZE; dx++) {
+        for (int dz = 0; dz < CHUNK_SIZE; dz++) {
+            int x = p * CHUNK_SIZE + dx; // X axis
+            int z = q * CHUNK_SIZE + dz; // Z axis
+            int i = dz * MAP_SPAN + dx;
+            int w;
+            int h = column_height(fields->height[i], fields->amplitude[i], &w);
+
+            // grass gen
+#if WORLD_DENSITY
+            h = heights[i];
+#else
+            for (int y = 0; y < h; y++) {
+                map_set(map, x, y, z, w);
+            }
+#endif
+            heights[i] = h;
+
+            // Gen plants
+            if (w == 1 && fields->plant[i]) {
+                map_set(map, x, h, z, 17); // write plants to map
+            }
+
+            // Gen long grass
+            if (w == 1 && fields->grass[i]) {
+                map_set(map, x, h, z, 18); // write long grass to map
+            }
+
+            // Gen tall grass biomes
+            if (w == 1 && fields->tall_grass[i]) {
+                map_set(map, x, h, z, 18);
+                map_set(map, x, h + 1, z, 18);
+
+                // Get the grass to generate at different heights
+                int check = rng_range(
+                    world_seed, x, h, z, RNG_TALL_GRASS, 0, 1);
+                if (check) {
+                    map_set(map, x, h + 2, z, 18);
+                }
+            }
+        }
+    }
+
+    // Complete trees! Roots outside the chunk still reach into it, so
+    // neighbouring chunks agree on every tree crossing their border
+    stamp_trees(map, fields, heights, tree_leaves, 1, p, q);
+    stamp_trees(map, fields, heights, tree_trunk, 0, p, q);
+}
+
+// Clouds are not part of chunk maps; the client meshes them on their own
+void make_clouds(unsigned char *clouds, int p, int q) {
+    Fields *fields = make_fields(p, q);
+    for (int i = 0; i < CLOUD_LAYER; i++) {
+        float *cloud = fields->cloud + i * CLOUD_LAYERS;
+        clouds[i] = 0;
+        for (int y = 0; y < CLOUD_LAYERS; y++) {
+            if (cloud[y] > 0.70) {
+                clouds[i] |= 1 << y;
+            }
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef _world_h_
+#define _world_h_
+
+#include "map.h"
+
+// Build with -DWORLD_LATTICE=4 or 8 to sample the slow height and amplitude
+// fields every that many blocks and interpolate between. Lattice cells
+// whose centre is off by more than WORLD_LATTICE_ERROR are sampled exactly.
+#ifndef WORLD_LATTICE
+#define WORLD_LATTICE 0
+#endif
+
+#ifndef WORLD_LATTICE_ERROR
+#define WORLD_LATTICE_ERROR 0.01f
+#endif
+
+// Build with -DWORLD_DENSITY=1 for terrain from a 3D density field, which
+// adds overhangs and caves near the surface. Its noise is sampled every
+// DENSITY_XZ x DENSITY_Y x DENSITY_XZ blocks and interpolated in between.
+#ifndef WORLD_DENSITY
+#define WORLD_DENSITY 0
+#endif
+
+#define DENSITY_XZ 4
+#define DENSITY_Y 8
+#define DENSITY_AMPLITUDE 8
+
+// Clouds fill CLOUD_LAYERS layers from y = CLOUD_BOTTOM up. Their mesh is
+// built from the chunk plus a one column ring, so no neighbour is needed.
+#define CLOUD_BOTTOM 70
+#define CLOUD_LAYERS 8
+#define CLOUD_PAD 1
+#define CLOUD_SPAN (CHUNK_SIZE + CLOUD_PAD * 2)
+#define CLOUD_LAYER (CLOUD_SPAN * CLOUD_SPAN)
+
+// Bump whenever make_world output changes, so cached chunks from older
+// generators are not reused
+#define WORLD_VERSION 1
+
+// Generation is a pure function of the seed and (p, q)
+void set_world_seed(unsigned int seed);
+unsigned int get_world_seed();
+unsigned int get_world_version();
+void make_world(Map *map, int p, int q);
+
+// Cloud cover of the CLOUD_SPAN x CLOUD_SPAN square, one byte per column
+// (z * CLOUD_SPAN + x) with bit i set when layer CLOUD_BOTTOM + i is cloud
+void make_clouds(unsigned char *clouds, int p, int q);
+
+#endif
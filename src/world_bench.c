@@ -0,0 +1,208 @@
+#define _POSIX_C_SOURCE 199309L // clock_gettime under -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "map.h"
+#include "noise.h"
+#include "world.h"
+
+// Headless make_world benchmark over a fixed grid of chunks with a fixed
+// seed. Prints one CSV line per chunk: p,q,checksum,blocks,bytes,noise2,
+// noise3,heights, where checksum covers every block, bytes is the
+// map_encode size, the noise columns count octaves summed and heights holds
+// the top block of every column in hex. Given a golden file from an
+// earlier run, every chunk is checked against it: a generator change
+// passes when each chunk is identical, or when no column top moved by more
+// than the tolerance.
+
+#define GRID 4 // chunks per side, from -GRID / 2
+#define ROUNDS 8 // timing passes, each over a fresh grid far away
+
+typedef struct {
+    int p;
+    int q;
+    unsigned long long checksum;
+    int blocks;
+    int bytes;
+    unsigned long noise2;
+    unsigned long noise3;
+    signed char heights[MAP_LAYER];
+} Chunk;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long long checksum(Map *map) {
+    unsigned long long hash = 1469598103934665603ull;
+    for (int y = 0; y < CHUNK_HEIGHT; y++) {
+        for (int z = 0; z < MAP_SPAN; z++) {
+            for (int x = 0; x < MAP_SPAN; x++) {
+                unsigned int w = map_get(map, map->dx + x, y, map->dz + z);
+                hash = (hash ^ w) * 1099511628211ull;
+            }
+        }
+    }
+    return hash;
+}
+
+static void make_chunk(Chunk *chunk, int p, int q, unsigned char *buffer) {
+    NoiseStats before, after;
+    Map map;
+    map_alloc_chunk(&map, p, q);
+    noise_stats(&before);
+    make_world(&map, p, q);
+    noise_stats(&after);
+    chunk->p = p;
+    chunk->q = q;
+    chunk->checksum = checksum(&map);
+    chunk->blocks = map.size;
+    chunk->bytes = map_encode(&map, buffer);
+    chunk->noise2 = after.octaves2 - before.octaves2;
+    chunk->noise3 = after.octaves3 - before.octaves3;
+    for (int i = 0; i < MAP_LAYER; i++) {
+        chunk->heights[i] = map_highest_block(
+            &map, map.dx + i % MAP_SPAN, map.dz + i / MAP_SPAN);
+    }
+    map_free(&map);
+}
+
+static void print_chunk(FILE *file, Chunk *chunk) {
+    fprintf(file, "%d,%d,%016llx,%d,%d,%lu,%lu,", chunk->p, chunk->q,
+        chunk->checksum, chunk->blocks, chunk->bytes,
+        chunk->noise2, chunk->noise3);
+    for (int i = 0; i < MAP_LAYER; i++) {
+        fprintf(file, "%02x", (unsigned char)chunk->heights[i]);
+    }
+    fprintf(file, "\n");
+}
+
+static int read_chunk(FILE *file, Chunk *chunk) {
+    if (fscanf(file, "%d,%d,%llx,%d,%d,%lu,%lu,", &chunk->p, &chunk->q,
+        &chunk->checksum, &chunk->blocks, &chunk->bytes,
+        &chunk->noise2, &chunk->noise3) != 7)
+    {
+        return 0;
+    }
+    for (int i = 0; i < MAP_LAYER; i++) {
+        unsigned int height;
+        if (fscanf(file, "%2x", &height) != 1) {
+            return 0;
+        }
+        chunk->heights[i] = height;
+    }
+    return 1;
+}
+
+// 0 when identical, 1 when within tolerance, 2 otherwise
+static int compare(Chunk *chunk, Chunk *golden, int tolerance, int *delta) {
+    *delta = 0;
+    for (int i = 0; i < MAP_LAYER; i++) {
+        int d = abs(chunk->heights[i] - golden->heights[i]);
+        *delta = d > *delta ? d : *delta;
+    }
+    if (chunk->checksum == golden->checksum) {
+        return 0;
+    }
+    return *delta <= tolerance ? 1 : 2;
+}
+
+int main(int argc, char **argv) {
+    const char *golden_path = 0;
+    int tolerance = 0;
+    unsigned int seed = 0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-g")) {
+            golden_path = argv[i + 1];
+        }
+        else if (!strcmp(argv[i], "-t")) {
+            tolerance = atoi(argv[i + 1]);
+        }
+        else if (!strcmp(argv[i], "-s")) {
+            seed = strtoul(argv[i + 1], 0, 0);
+        }
+    }
+    set_world_seed(seed);
+    unsigned char *buffer = (unsigned char *)malloc(MAP_ENCODED_SIZE);
+    Chunk *chunks = (Chunk *)malloc(GRID * GRID * sizeof(Chunk));
+    int count = 0;
+    for (int p = -GRID / 2; p < GRID - GRID / 2; p++) {
+        for (int q = -GRID / 2; q < GRID - GRID / 2; q++) {
+            make_chunk(chunks + count++, p, q, buffer);
+        }
+    }
+
+    // timing runs apart from the checks, each round on chunks nobody has
+    // generated yet so cached fields don't flatter the numbers
+    double elapsed = 0;
+    for (int round = 1; round <= ROUNDS; round++) {
+        for (int p = 0; p < GRID; p++) {
+            for (int q = 0; q < GRID; q++) {
+                Map map;
+                map_alloc_chunk(&map, round * 1000 + p, q);
+                double start = now();
+                make_world(&map, round * 1000 + p, q);
+                elapsed += now() - start;
+                map_free(&map);
+            }
+        }
+    }
+
+    printf("p,q,checksum,blocks,bytes,noise2,noise3,heights\n");
+    long blocks = 0, bytes = 0;
+    unsigned long noise2 = 0, noise3 = 0;
+    for (int i = 0; i < count; i++) {
+        print_chunk(stdout, chunks + i);
+        blocks += chunks[i].blocks;
+        bytes += chunks[i].bytes;
+        noise2 += chunks[i].noise2;
+        noise3 += chunks[i].noise3;
+    }
+    int timed = GRID * GRID * ROUNDS;
+    fprintf(stderr, "seed %u, %d chunks: %.1f chunks/s, %.3f ms/chunk\n",
+        seed, timed, timed / (elapsed / 1e9), elapsed / 1e6 / timed);
+    fprintf(stderr, "per chunk: %.0f noise2 octaves, %.0f noise3 octaves, "
+        "%.0f blocks, %.0f encoded bytes\n",
+        (double)noise2 / count, (double)noise3 / count,
+        (double)blocks / count, (double)bytes / count);
+
+    int result = 0;
+    if (golden_path) {
+        FILE *file = fopen(golden_path, "r");
+        if (!file) {
+            fprintf(stderr, "cannot read %s\n", golden_path);
+            return 1;
+        }
+        fscanf(file, "%*[^\n]\n");
+        int same = 0, close = 0, failed = 0;
+        Chunk golden;
+        while (read_chunk(file, &golden)) {
+            for (int i = 0; i < count; i++) {
+                Chunk *chunk = chunks + i;
+                if (chunk->p != golden.p || chunk->q != golden.q) {
+                    continue;
+                }
+                int delta;
+                int status = compare(chunk, &golden, tolerance, &delta);
+                same += status == 0;
+                close += status == 1;
+                failed += status == 2;
+                if (status) {
+                    fprintf(stderr, "chunk %d,%d differs, column tops by "
+                        "up to %d\n", chunk->p, chunk->q, delta);
+                }
+            }
+        }
+        fclose(file);
+        fprintf(stderr, "golden: %d identical, %d within tolerance %d, "
+            "%d failed, %d missing\n", same, close, tolerance, failed,
+            count - same - close - failed);
+        result = failed || same + close + failed != count;
+    }
+    free(chunks);
+    free(buffer);
+    return result;
+}